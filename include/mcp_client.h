@@ -8,10 +8,59 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <utility>
 
 namespace mcp {
+	// Walks a paginated list method (resources/list, tools/list) one item at a time.
+	// The next page is only requested once the items of the current one are used up.
+	class paginated_list {
+		public:
+			using fetch_page = std::function<json(const std::string& cursor)>;
+
+			paginated_list(fetch_page fetch, std::string items_key)
+				: fetch_(std::move(fetch)), items_key_(std::move(items_key)) {}
+
+			// Get the next item, returns false once every page has been consumed
+			bool next(json& item) {
+				while (index_ >= page_.size()) {
+					if (done_) {
+						return false;
+					}
+
+					json result = fetch_(cursor_);
+					page_ = result.contains(items_key_) && result[items_key_].is_array() ? result[items_key_] : json::array();
+					index_ = 0;
+
+					if (result.contains("nextCursor") && result["nextCursor"].is_string() && !result["nextCursor"].get<std::string>().empty()) {
+						cursor_ = result["nextCursor"].get<std::string>();
+					} else {
+						done_ = true;
+					}
+				}
+
+				item = page_[index_++];
+				return true;
+			}
+
+		private:
+			fetch_page fetch_;
+			std::string items_key_;
+			std::string cursor_;
+			json page_ = json::array();
+			size_t index_ = 0;
+			bool done_ = false;
+	};
+
 	class client {
 		public:
+			// Completion of an asynchronous request. Runs on the client's receive thread, on its timer thread
+			// when the request times out, or on the calling thread when the request fails to send or is
+			// answered in the POST body. It must not block.
+			using response_callback = std::function<void(const response&)>;
+
 			virtual ~client() = default;
 
 			virtual bool initialize(const std::string& client_name, const std::string& client_version) = 0;
@@ -24,12 +73,72 @@ namespace mcp {
 
 			virtual void send_notification(const std::string& method, const json& params = json::object()) = 0;
 
+			// Send several requests as one JSON-RPC batch, in a single round trip.
+			// Returns one response per request that has an id, in request order. A failed call
+			// is reported in its response's error instead of being thrown.
+			virtual std::vector<response> send_batch(const std::vector<request>& requests) = 0;
+
+			// Asynchronous request. Only sending happens on the calling thread, the response completes the
+			// callback on the receive thread, so many calls can be outstanding without a thread each.
+			// A send error is reported as an error response, and so are requests still outstanding when
+			// the connection closes and requests not answered within the client's request timeout (request_timeout).
+			virtual void send_request_async(const std::string& method, const json& params, response_callback callback) = 0;
+
+			// Asynchronous request whose future holds the result, or an mcp_exception for an error response
+			std::future<json> send_request_async(const std::string& method, const json& params = json::object()) {
+				auto promise = std::make_shared<std::promise<json>>();
+				std::future<json> future = promise->get_future();
+
+				send_request_async(method, params, [promise](const response& res) {
+					if (res.is_error()) {
+						int code = res.error.contains("code") && res.error["code"].is_number_integer()
+							? res.error["code"].get<int>() : static_cast<int>(error_code::internal_error);
+						std::string message = res.error.contains("message") && res.error["message"].is_string()
+							? res.error["message"].get<std::string>() : std::string("Unknown error");
+						promise->set_exception(std::make_exception_ptr(mcp_exception(static_cast<error_code>(code), message)));
+					} else {
+						promise->set_value(res.result);
+					}
+				});
+
+				return future;
+			}
+
+			std::future<json> call_tool_async(const std::string& tool_name, const json& arguments = json::object()) {
+				return send_request_async("tools/call", {
+					{"name", tool_name},
+					{"arguments", arguments}
+				});
+			}
+
+			void call_tool_async(const std::string& tool_name, const json& arguments, response_callback callback) {
+				send_request_async("tools/call", {
+					{"name", tool_name},
+					{"arguments", arguments}
+				}, std::move(callback));
+			}
+
+			std::future<json> read_resource_async(const std::string& resource_uri) {
+				return send_request_async("resources/read", {
+					{"uri", resource_uri}
+				});
+			}
+
+			void read_resource_async(const std::string& resource_uri, response_callback callback) {
+				send_request_async("resources/read", {
+					{"uri", resource_uri}
+				}, std::move(callback));
+			}
+
 			virtual json get_server_capabilities() = 0;
 
 			virtual json call_tool(const std::string& tool_name, const json& arguments = json::object()) = 0;
 
 			virtual std::vector<tool> get_tools() = 0;
 
+			// One page of tools/list, pass the previous page's nextCursor to continue
+			virtual json list_tools(const std::string& cursor = "") = 0;
+
 			virtual json get_capabilities() = 0;
 
 			virtual json list_resources(const std::string& cursor = "") = 0;
@@ -41,6 +150,76 @@ namespace mcp {
 			virtual json list_resource_templates() = 0;
 
 			virtual bool is_running() const = 0;
+
+			// Lazily iterate over every resource, fetching pages on demand
+			paginated_list iterate_resources() {
+				return paginated_list([this](const std::string& cursor) { return list_resources(cursor); }, "resources");
+			}
+
+			// Lazily iterate over every tool, fetching pages on demand
+			paginated_list iterate_tools() {
+				return paginated_list([this](const std::string& cursor) { return list_tools(cursor); }, "tools");
+			}
+
+		protected:
+			// Pending requests are completed with the result, or with {"isError": true, "error": ...} for an error.
+			// Transports keep them in a pending_table keyed by request id and complete each one at most once:
+			// whoever takes it out of the table (response, timeout or closed connection) runs it.
+			using completion = std::function<void(json)>;
+
+			// Response for request id from the value a pending request was completed with
+			static response make_response(const json& id, const json& value) {
+				if (value.is_object() && value.contains("isError") && value["isError"].is_boolean() &&
+					value["isError"].get<bool>() && value.contains("error")) {
+					response res;
+					res.id = id;
+					res.error = value["error"];
+					return res;
+				}
+				return response::create_success(id, value);
+			}
+
+			// Requests of a batch that expect a response, in request order, with the futures their completions fulfil
+			using batch_waiters = std::vector<std::pair<json, std::future<json>>>;
+
+			// Completion to register as pending for id, it fulfils the future added to waiting
+			static completion expect_batch_response(const json& id, batch_waiters& waiting) {
+				auto response_promise = std::make_shared<std::promise<json>>();
+				waiting.emplace_back(id, response_promise->get_future());
+				return [response_promise](json value) {
+					response_promise->set_value(std::move(value));
+				};
+			}
+
+			// Wait for every response of a batch until the shared deadline and convert them in request order.
+			// A request still unanswered at the deadline is handed to forget, which removes it from the
+			// pending requests, and gets a timeout error.
+			static std::vector<response> await_batch(batch_waiters& waiting, std::chrono::steady_clock::time_point deadline,
+				const std::function<void(const json& id)>& forget) {
+				std::vector<response> responses;
+				responses.reserve(waiting.size());
+				for (auto& [id, future] : waiting) {
+					if (future.wait_until(deadline) != std::future_status::ready) {
+						forget(id);
+						responses.push_back(response::create_error(id, error_code::internal_error, "Timeout waiting for response"));
+						continue;
+					}
+
+					responses.push_back(make_response(id, future.get()));
+				}
+				return responses;
+			}
+
+			// Value that completes a pending request with an error
+			static json error_value(error_code code, const std::string& message) {
+				return {
+					{"isError", true},
+					{"error", {
+						{"code", static_cast<int>(code)},
+						{"message", message}
+					}}
+				};
+			}
 	};
 } // namespace mcp
 
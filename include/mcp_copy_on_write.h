@@ -0,0 +1,42 @@
+#ifndef MCP_COPY_ON_WRITE_H
+#define MCP_COPY_ON_WRITE_H
+
+#include <memory>
+#include <mutex>
+
+namespace mcp {
+
+    // Immutable value that readers load without taking a lock.
+    // A writer copies the current value, modifies the copy and publishes it atomically.
+    // Readers keep whichever version they loaded for as long as they hold the pointer,
+    // so a snapshot never changes underneath them.
+    template <typename T>
+    class copy_on_write {
+        public:
+            copy_on_write() : current_(std::make_shared<const T>()) {}
+
+            copy_on_write(const copy_on_write&) = delete;
+            copy_on_write& operator=(const copy_on_write&) = delete;
+
+            std::shared_ptr<const T> load() const {
+                return std::atomic_load(&current_);
+            }
+
+            // Publish the value mutate leaves in a copy of the current one.
+            // Writers are serialized, readers are never blocked.
+            template <typename F>
+            void update(F&& mutate) {
+                std::lock_guard<std::mutex> lock(writer_mutex_);
+                auto next = std::make_shared<T>(*std::atomic_load(&current_));
+                mutate(*next);
+                std::atomic_store(&current_, std::shared_ptr<const T>(std::move(next)));
+            }
+
+        private:
+            std::shared_ptr<const T> current_;
+            std::mutex writer_mutex_;
+    };
+
+} // namespace mcp
+
+#endif // MCP_COPY_ON_WRITE_H
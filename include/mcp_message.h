@@ -6,6 +6,8 @@
 #include <map>
 #include <memory>
 #include <stdexcept>
+#include <atomic>
+#include <cstdint>
 
 #include "json.hpp"
 
@@ -24,6 +26,8 @@ namespace mcp {
         method_not_found = -32601,      // Method not found
         invalid_params = -32602,        // Invalid method parameters
         internal_error = -32603,        // Internal JSON-RPC error
+        request_timeout = -32001,       // Request not finished before its deadline
+        request_cancelled = -32002,     // Request cancelled by the client
         server_error_start = -32000,    // Server error start
         server_error_end = -32099       // Server error end
     };
@@ -110,10 +114,11 @@ namespace mcp {
         }
 
         private:
-            // Generate a unique ID
+            // Generate a unique ID, unique across threads and a non-negative integer so clients can key
+            // pending requests by it
             static json generate_id() {
-                static int next_id = 1;
-                return next_id++;
+                static std::atomic<uint64_t> next_id{1};
+                return next_id.fetch_add(1, std::memory_order_relaxed);
             }
     };
 
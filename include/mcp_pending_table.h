@@ -0,0 +1,181 @@
+#ifndef MCP_PENDING_TABLE_H
+#define MCP_PENDING_TABLE_H
+
+#include "mcp_message.h"
+
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+namespace mcp {
+
+    // Outstanding requests of a client, keyed by request id.
+    // Ids made by request::generate_id are non-negative integers and live in an open-addressing table
+    // with linear probing, so correlating a response is a hash of one integer and never allocates.
+    // Any other id (strings, negative numbers) falls back to an ordered map.
+    // Not synchronized, the client guards it with its own mutex.
+    template <typename Value>
+    class pending_table {
+        public:
+            explicit pending_table(size_t initial_capacity = 64) {
+                size_t capacity = 16;
+                while (capacity < initial_capacity) {
+                    capacity <<= 1;
+                }
+                slots_.resize(capacity);
+            }
+
+            // Insert or replace the value of id
+            void insert(const json& id, Value value) {
+                uint64_t key;
+                if (!integer_key(id, key)) {
+                    foreign_[id] = std::move(value);
+                    return ;
+                }
+
+                // Keep the load factor at or below 1/2 so probe sequences stay short
+                if ((size_ + 1) * 2 > slots_.size()) {
+                    grow();
+                }
+
+                size_t i = find_slot(key);
+                if (!slots_[i].used) {
+                    slots_[i].used = true;
+                    slots_[i].key = key;
+                    ++size_;
+                }
+                slots_[i].value = std::move(value);
+            }
+
+            // Remove id and move its value to out, false if id is not pending
+            bool take(const json& id, Value& out) {
+                uint64_t key;
+                if (!integer_key(id, key)) {
+                    auto it = foreign_.find(id);
+                    if (it == foreign_.end()) {
+                        return false;
+                    }
+                    out = std::move(it->second);
+                    foreign_.erase(it);
+                    return true;
+                }
+
+                size_t i = find_slot(key);
+                if (!slots_[i].used) {
+                    return false;
+                }
+                out = std::move(slots_[i].value);
+                remove_slot(i);
+                return true;
+            }
+
+            bool erase(const json& id) {
+                Value discarded;
+                return take(id, discarded);
+            }
+
+            // Remove every entry and hand the values back to the caller
+            std::vector<Value> take_all() {
+                std::vector<Value> values;
+                values.reserve(size());
+                for (auto& slot : slots_) {
+                    if (slot.used) {
+                        values.push_back(std::move(slot.value));
+                        slot.value = Value();
+                        slot.used = false;
+                    }
+                }
+                for (auto& entry : foreign_) {
+                    values.push_back(std::move(entry.second));
+                }
+                foreign_.clear();
+                size_ = 0;
+                return values;
+            }
+
+            size_t size() const {
+                return size_ + foreign_.size();
+            }
+
+            bool empty() const {
+                return size() == 0;
+            }
+
+        private:
+            struct slot {
+                uint64_t key = 0;
+                bool used = false;
+                Value value;
+            };
+
+            static bool integer_key(const json& id, uint64_t& key) {
+                if (id.is_number_unsigned()) {
+                    key = id.get<uint64_t>();
+                    return true;
+                }
+                if (id.is_number_integer() && id.get<int64_t>() >= 0) {
+                    key = static_cast<uint64_t>(id.get<int64_t>());
+                    return true;
+                }
+                return false;
+            }
+
+            // Fibonacci hashing spreads the sequential ids over the table
+            size_t home(uint64_t key) const {
+                return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (slots_.size() - 1);
+            }
+
+            // Slot holding key, or the empty slot where it would go
+            size_t find_slot(uint64_t key) const {
+                size_t mask = slots_.size() - 1;
+                size_t i = home(key);
+                while (slots_[i].used && slots_[i].key != key) {
+                    i = (i + 1) & mask;
+                }
+                return i;
+            }
+
+            // Backward shift deletion, later entries of the probe run move up so no tombstones are needed
+            void remove_slot(size_t hole) {
+                size_t mask = slots_.size() - 1;
+                size_t i = (hole + 1) & mask;
+                while (slots_[i].used) {
+                    size_t h = home(slots_[i].key);
+                    // The entry may fill the hole if its home is not cyclically within (hole, i]
+                    bool movable = hole <= i ? (h <= hole || h > i) : (h <= hole && h > i);
+                    if (movable) {
+                        slots_[hole].key = slots_[i].key;
+                        slots_[hole].value = std::move(slots_[i].value);
+                        hole = i;
+                    }
+                    i = (i + 1) & mask;
+                }
+                slots_[hole].used = false;
+                slots_[hole].value = Value();
+                --size_;
+            }
+
+            void grow() {
+                std::vector<slot> old(slots_.size() * 2);
+                old.swap(slots_);
+                size_ = 0;
+                for (auto& entry : old) {
+                    if (entry.used) {
+                        size_t i = find_slot(entry.key);
+                        slots_[i].used = true;
+                        slots_[i].key = entry.key;
+                        slots_[i].value = std::move(entry.value);
+                        ++size_;
+                    }
+                }
+            }
+
+            std::vector<slot> slots_;
+            size_t size_ = 0;
+            std::map<json, Value> foreign_;
+    };
+
+} // namespace mcp
+
+#endif // MCP_PENDING_TABLE_H
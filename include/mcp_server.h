@@ -5,12 +5,18 @@
 #include "mcp_resource.h"
 #include "mcp_tool.h"
 #include "mcp_thread_pool.h"
+#include "mcp_timer_wheel.h"
+#include "mcp_sharded_map.h"
+#include "mcp_copy_on_write.h"
+#include "mcp_sse_reactor.h"
 #include "mcp_logger.h"
 
 #include "httplib.h"
 
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <deque>
 #include <vector>
 #include <memory>
 #include <mutex>
@@ -20,6 +26,7 @@
 #include <condition_variable>
 #include <future>
 #include <atomic>
+#include <type_traits>
 
 namespace mcp {
 
@@ -29,10 +36,25 @@ namespace mcp {
     using auth_handler = std:function<bool(const std::string, const std::string&)>;
     using session_cleanup_handler = std::function<void(const std::string&)>;
 
+    class cancellation_token;
+    // Tool handler that may run for a long time, it should check token and return early once it is cancelled
+    using async_tool_handler = std::function<json(const json&, const std::string&, const cancellation_token&)>;
+
+    // What send_event does when a session's queue is already full
+    enum class queue_overflow_policy {
+        block,                  // Wait up to the send timeout for the writer to drain a slot (or the dispatcher to close)
+        drop_oldest_heartbeat,  // Evict the oldest queued heartbeat, block if there is none
+        fail                    // Reject the new event immediately
+    };
+
     class event_dispatcher {
         public:
-            event_dispatcher() {
-                message_.reserve(128) // 为 message 提前预留空间
+            // A sender blocked on a full queue gives up after send_timeout, so a stalled reader
+            // cannot hold the threads that produce its events
+            explicit event_dispatcher(size_t max_queue_size = 256,
+                queue_overflow_policy policy = queue_overflow_policy::drop_oldest_heartbeat,
+                std::chrono::milliseconds send_timeout = std::chrono::seconds(5))
+                : max_queue_size_(max_queue_size == 0 ? 1 : max_queue_size), policy_(policy), send_timeout_(send_timeout) {
             }
 
             ~event_dispatcher() {
@@ -40,73 +62,124 @@ namespace mcp {
             }
 
             bool wait_event(httplib::DataSink* sink, const std::chrono::milliseconds& timeout = std::chrono::milliseconds(10000)) {
-                if (!sink || closed_.load(std::memory_order_acquire)) {
+                if (!sink) {
                     return false;
                 }
 
-                std::string message_copy;
+                std::deque<queued_event> events;
+                size_t total_size = 0;
+                bool closing = false;
                 {
                     std::unique_lock<std::mutex> lk(m_);
 
-                    if (closed_.load(std::memory_order_acquire)) {
-                        return false;
-                    }
-
-                    int id = id_.load(std::memory_order_relaxed);
-
-                    bool result = cv_.wait_for(lk, timeout, [&] {
-                        return cid_.load(std::memory_order_relaxed) == id || closed_.load(std::memory_order_acquire);
+                    cv_.wait_for(lk, timeout, [&] {
+                        return !queue_.empty() || closed_.load(std::memory_order_acquire);
                     });
 
-                    if (closed_.load(std::memory_order_acquire)) {
+                    // Timed out, or closed with nothing left to deliver
+                    if (queue_.empty()) {
                         return false;
                     }
 
-                    if (!result) {
-                        return false;
-                    }
+                    // A closed dispatcher still flushes what was queued before the close,
+                    // so responses finished during a graceful shutdown reach the client
+                    closing = closed_.load(std::memory_order_acquire);
 
-                    if (!message_.empty()) {
-                        message_copy.swap(message_);
-                    } else {
-                        return true;
-                    }
+                    // Take everything that is queued so one wake-up delivers all pending events
+                    events.swap(queue_);
+                    total_size = queued_bytes_;
+                    queued_bytes_ = 0;
                 }
 
+                // Queue slots are free again, wake up blocked senders
+                space_cv_.notify_all();
+
                 try {
-                    if (!message_copy.empty()) {
-                        if (!sink->write(message_copy.data(), message_copy.size())) {
-                            close();
-                            return false;
+                    // A single event is written as is, a burst is coalesced into one chunk
+                    // so the whole batch costs one sink write instead of one per event
+                    const std::string* payload = &events.front().data;
+                    if (events.size() > 1) {
+                        write_buffer_.clear();
+                        write_buffer_.reserve(total_size);
+                        for (const auto& event : events) {
+                            write_buffer_.append(event.data);
                         }
+                        payload = &write_buffer_;
                     }
-                    return true;
+
+                    if (!sink->write(payload->data(), payload->size())) {
+                        close();
+                        return false;
+                    }
+                    return !closing;
                 } catch (...) {
                     close();
                     return false;
                 }
             }
 
-            bool send_event(const std::string& message) {
-                if (closed_.load(std::memry_order_acquire)) {
+            // Non-blocking counterpart of wait_event for an event loop: append everything queued to out.
+            // Returns false once the dispatcher is closed, what was queued before the close is still appended.
+            bool take_events(std::string& out) {
+                bool taken;
+                bool open;
+                {
+                    std::lock_guard<std::mutex> lk(m_);
+                    taken = !queue_.empty();
+                    out.reserve(out.size() + queued_bytes_);
+                    for (const auto& event : queue_) {
+                        out.append(event.data);
+                    }
+                    queue_.clear();
+                    queued_bytes_ = 0;
+                    open = !closed_.load(std::memory_order_acquire);
+                }
+
+                if (taken) {
+                    space_cv_.notify_all();
+                }
+                return open;
+            }
+
+            // Run handler when an event is queued on an empty queue and when the dispatcher closes,
+            // so an event loop knows when to call take_events. It runs with the dispatcher's lock held
+            // and must not call back into the dispatcher. Pass nullptr to remove it.
+            void set_ready_handler(std::function<void()> handler) {
+                std::lock_guard<std::mutex> lk(m_);
+                ready_handler_ = std::move(handler);
+            }
+
+            bool send_event(const std::string& message, bool is_heartbeat = false) {
+                if (closed_.load(std::memory_order_acquire)) {
                     return false;
                 }
 
                 try {
-                    std::lock_guard<std::mutex> lk(m_);
+                    std::unique_lock<std::mutex> lk(m_);
 
                     if (closed_.load(std::memory_order_acquire)) {
                         return false;
                     }
 
-                    // Efficiently set the message and allocate space as needed
-                    if (message.size() > message_.capacity()) {
-                        message_.reserve(message.size() + 64); // Pre-allocate extra space to avoid frequent reallocations
+                    if (queue_.size() >= max_queue_size_) {
+                        // The client is already behind, a dropped heartbeat is not a delivery failure.
+                        // Heartbeats never wait for space, they are sent from the shared timer thread.
+                        if (is_heartbeat) {
+                            return true;
+                        }
+
+                        if (!make_room(lk)) {
+                            return false;
+                        }
                     }
-                    message_ = message;
 
-                    cid_.store(id_.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+                    queue_.push_back(queued_event{message, is_heartbeat});
+                    queued_bytes_ += message.size();
                     cv_.notify_one(); // 通知等待的线程
+                    // An event loop takes the whole queue at once, so it only needs to hear about the first event
+                    if (ready_handler_ && queue_.size() == 1) {
+                        ready_handler_();
+                    }
                     return true;
                 } catch (...) {
                     return false;
@@ -121,36 +194,148 @@ namespace mcp {
                     return ;
                 }
                 try {
+                    // Take the lock so a waiter cannot miss the notification between its predicate check and sleep
+                    std::lock_guard<std::mutex> lk(m_);
                     cv_.notify_all();
+                    space_cv_.notify_all();
+                    if (ready_handler_) {
+                        ready_handler_();
+                    }
                 } catch (...) {
                     // Ignore exceptions
                 }
             }
 
             bool is_closed() const {
-                return closed_.load(std:memory_order_acquire);
+                return closed_.load(std::memory_order_acquire);
             }
 
-            // Get the last activity time
-            std::chrono::steady_clock::time_point last_activity() const {
+            // Number of events waiting to be written to the client
+            size_t queue_size() const {
                 std::lock_guard<std::mutex> lk(m_);
-                return last_activity_;
+                return queue_.size();
             }
 
-            // Update the activity time (when sending or receiving a message)
+            // Get the last activity time, lock-free
+            std::chrono::steady_clock::time_point last_activity() const {
+                return std::chrono::steady_clock::time_point(
+                    std::chrono::steady_clock::duration(last_activity_.load(std::memory_order_relaxed)));
+            }
+
+            // Update the activity time (when sending or receiving a message).
+            // Lock-free so it never contends with send_event / wait_event on m_.
             void update_activity() {
-                std::lock_guard<std::mutex> lk(m_);
-                last_activity_ = std::chrono::steady_clock::now();
+                last_activity_.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
             }
 
         private:
+            struct queued_event {
+                std::string data;
+                bool is_heartbeat;
+            };
+
+            // Apply the overflow policy to a full queue, called with m_ held.
+            // Returns false if the new event must be rejected.
+            bool make_room(std::unique_lock<std::mutex>& lk) {
+                if (policy_ == queue_overflow_policy::fail) {
+                    return false;
+                }
+
+                if (policy_ == queue_overflow_policy::drop_oldest_heartbeat) {
+                    for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+                        if (it->is_heartbeat) {
+                            queued_bytes_ -= it->data.size();
+                            queue_.erase(it);
+                            return true;
+                        }
+                    }
+                }
+
+                // Block until the writer drains the queue, the dispatcher is closed or the send times out
+                bool has_room = space_cv_.wait_for(lk, send_timeout_, [&] {
+                    return queue_.size() < max_queue_size_ || closed_.load(std::memory_order_acquire);
+                });
+
+                return has_room && !closed_.load(std::memory_order_acquire);
+            }
+
             mutable std::mutex m_;
             std::condition_variable cv_;
-            std::atomic<int> id_{0};
-            std::atomic<int> cid_{-1};
-            std::string message_;
+            std::condition_variable space_cv_;
+            std::deque<queued_event> queue_;
+            size_t queued_bytes_ = 0;
+            // Only touched by the thread running wait_event, reused across wake-ups
+            std::string write_buffer_;
+            std::function<void()> ready_handler_;
+            const size_t max_queue_size_;
+            const queue_overflow_policy policy_;
+            const std::chrono::milliseconds send_timeout_;
             std::atomic<bool> closed_{false};
-            std::chrono::steady_clock::time_point last_activity_{std::chrono::steady_clock::now()};
+            // steady_clock ticks since epoch of the last activity
+            std::atomic<std::chrono::steady_clock::rep> last_activity_{std::chrono::steady_clock::now().time_since_epoch().count()};
+    };
+
+    // Cancellation state shared between the caller of an async tool and the running handler.
+    // Copies refer to the same state; cancellation is cooperative.
+    class cancellation_token {
+        public:
+            cancellation_token() : state_(std::make_shared<state>()) {}
+
+            // Token that also counts as cancelled once timeout has elapsed
+            static cancellation_token with_timeout(std::chrono::milliseconds timeout) {
+                cancellation_token token;
+                token.state_->deadline = std::chrono::steady_clock::now() + timeout;
+                token.state_->has_deadline = true;
+                return token;
+            }
+
+            // Cancel and run the callbacks registered with on_cancel, once
+            void cancel() {
+                std::vector<std::function<void()>> callbacks;
+                {
+                    std::lock_guard<std::mutex> lock(state_->mutex);
+                    if (state_->cancelled.exchange(true, std::memory_order_acq_rel)) {
+                        return ;
+                    }
+                    callbacks.swap(state_->callbacks);
+                }
+
+                for (auto& callback : callbacks) {
+                    callback();
+                }
+            }
+
+            // Run callback when cancel() is called, right away if it already was.
+            // A deadline passing does not run it, whoever owns the deadline calls cancel() then.
+            void on_cancel(std::function<void()> callback) {
+                {
+                    std::lock_guard<std::mutex> lock(state_->mutex);
+                    if (!state_->cancelled.load(std::memory_order_acquire)) {
+                        state_->callbacks.push_back(std::move(callback));
+                        return ;
+                    }
+                }
+                callback();
+            }
+
+            bool deadline_exceeded() const {
+                return state_->has_deadline && std::chrono::steady_clock::now() >= state_->deadline;
+            }
+
+            bool is_cancelled() const {
+                return state_->cancelled.load(std::memory_order_acquire) || deadline_exceeded();
+            }
+
+        private:
+            struct state {
+                std::atomic<bool> cancelled{false};
+                bool has_deadline = false;
+                std::chrono::steady_clock::time_point deadline;
+                std::mutex mutex;
+                std::vector<std::function<void()>> callbacks;
+            };
+
+            std::shared_ptr<state> state_;
     };
 
     class server {
@@ -176,6 +361,12 @@ namespace mcp {
 
             void register_tool(const tool& tool, tool_handler handler);
 
+            // Register a tool whose calls may run for a long time.
+            // Over SSE the call is answered when the handler returns, or with request_cancelled as soon as the client
+            // sends notifications/cancelled for it, or with request_timeout once timeout has elapsed (0 for no deadline).
+            // The handler runs on the session's lane and should return early once its token is cancelled.
+            void register_async_tool(const tool& tool, async_tool_handler handler, std::chrono::milliseconds timeout = std::chrono::seconds(60));
+
             void register_session_cleanup(const std::string& key, session_cleanup_handler handler);
 
             std::vector<tool> get_tools() const;
@@ -186,6 +377,58 @@ namespace mcp {
 
             bool set_mount_point(const std::string& mount_point, const std::string& dir, httplib::Headers headers = httplib::Headers());
 
+            // Page size of tools/list and resources/list (default 100), 0 disables pagination
+            void set_list_page_size(size_t page_size);
+
+            // Close sessions without activity for this long (default 60 minutes, 0 disables), applies to new sessions
+            void set_session_idle_timeout(std::chrono::milliseconds timeout);
+
+            // Configure the per-session SSE event queue used by sessions opened after this call.
+            // A send blocked on a full queue fails after send_timeout.
+            void set_session_queue_options(size_t max_depth, queue_overflow_policy policy,
+                                           std::chrono::milliseconds send_timeout = std::chrono::seconds(5));
+
+            // Maximum number of requests of one session handled at the same time, applies to new sessions.
+            // 1 handles a session's messages strictly in arrival order, 0 (the default) sets no per-session cap.
+            // Either way sessions take turns on the shared pool, one session's backlog does not delay the others.
+            // ping, initialize and the listings are control-plane calls and are answered ahead of the session's queue,
+            // unless a limit is set: then they queue on the session's lane too, so the limit and the order hold for every message.
+            void set_session_concurrency(size_t max_concurrency);
+
+            // Upper bound on how long stop() waits for accepted requests to finish (default 5 seconds).
+            // stop() refuses new messages first, then drains the pool: requests still queued are run too,
+            // so the wait grows with the backlog. Whatever is left at the deadline still runs, but its
+            // response is dropped with the closed sessions.
+            void set_shutdown_timeout(std::chrono::milliseconds timeout);
+
+            // Limits on work accepted through the message endpoint, 0 disables a limit.
+            // A session over its own limit is answered 429, a server over a global limit 503, both with Retry-After.
+            // A body larger than max_bytes_in_flight on its own is answered 413 without Retry-After.
+            void set_admission_limits(size_t max_queued_requests, size_t max_queued_per_session, size_t max_bytes_in_flight);
+
+            // Streamable HTTP mode: when the client accepts application/json, requests are answered in the body
+            // of their POST instead of over the SSE stream. They are scheduled like any other request and the
+            // connection thread waits for the result. Notifications are still answered 202. Off by default.
+            void set_streamable_http(bool enabled);
+
+            // How long a streamable HTTP request waits for its result before it is answered with a timeout error (default 60 seconds)
+            void set_inline_response_timeout(std::chrono::milliseconds timeout);
+
+            // Gauges of the request queues
+            struct queue_stats {
+                // Requests accepted and not finished yet
+                size_t queued_requests = 0;
+                // Body bytes of those requests
+                size_t bytes_in_flight = 0;
+                // Tasks waiting for a worker
+                size_t pool_pending_tasks = 0;
+                size_t sessions = 0;
+                // Requests refused by admission control since the server was created
+                uint64_t rejected_requests = 0;
+            };
+
+            queue_stats get_queue_stats() const;
+
         private:
                 std::string host_;
                 int port_;
@@ -197,30 +440,142 @@ namespace mcp {
 
                 std::unique_ptr<srd::thread> server_thread_;
 
-                std::map<std::string, std::unique_ptr<std::thread>> sse_threads_;
 
                 event_dispatcher sse_dispatcher_;
 
-                std::map<std::string, std::shared_ptr<event_dispatcher>> session_dispatchers_;
+                // Everything the server tracks for one SSE session
+                struct session {
+                    session(std::shared_ptr<event_dispatcher> session_dispatcher, std::shared_ptr<task_lane> session_lane, bool session_limited)
+                        : dispatcher(std::move(session_dispatcher)), lane(std::move(session_lane)), limited(session_limited) {}
+
+                    std::shared_ptr<event_dispatcher> dispatcher;
+                    // Messages of this session, run on the shared thread pool in arrival order
+                    std::shared_ptr<task_lane> lane;
+                    // Capped by set_session_concurrency, then every message goes through the lane so the
+                    // limit and the arrival order also hold for control-plane calls
+                    const bool limited;
+                    std::atomic<bool> initialized{false};
+                    // Requests of this session accepted and not finished yet
+                    std::atomic<size_t> queued{0};
+                    // Endpoint announcement / heartbeat timer.
+                    // Armed after the session is in the table, so the ids are set while it may already be closing.
+                    std::atomic<timer_wheel::timer_id> heartbeat_timer{0};
+                    // Closes the session once it has been inactive for session_idle_timeout_
+                    std::atomic<timer_wheel::timer_id> idle_timer{0};
+                };
+
+                // Sessions by id, sharded so per-request lookups do not serialize on one lock
+                sharded_map<std::string, session> sessions_;
 
                 std::string sse_endpoint_;
                 std::string msg_endpoint_;
 
-                std::map<std::string, method_handler> method_handlers_;
+                // Serialized list result, filled at most once per registry version
+                struct serialized_result {
+                    serialized_result() = default;
+
+                    // Copying deliberately yields an empty cache instead of the source's text.
+                    // The registry is only copied by update_registry to build the next version, and the
+                    // listing cached for the old version is stale for it. std::once_flag cannot be copied
+                    // either, so a defaulted copy would not compile.
+                    serialized_result(const serialized_result&) {}
+                    serialized_result& operator=(const serialized_result&) { return *this; }
+
+                    std::once_flag once;
+                    std::string text;
+                };
+
+                // Immutable snapshot of everything registered on the server.
+                // Registration copies the current snapshot, modifies the copy and publishes it atomically,
+                // request dispatch only loads the pointer and never takes a lock.
+                struct registry {
+                    uint64_t version = 0;
+                    std::unordered_map<std::string, method_handler> method_handlers;
+                    std::unordered_map<std::string, notification_handler> notification_handlers;
+                    // Ordered, so listings are returned in a stable order
+                    std::map<std::string, std::pair<tool, tool_handler>> tools;
+                    // Tools registered with register_async_tool, tools also holds a blocking adapter of each
+                    struct async_tool {
+                        async_tool_handler handler;
+                        std::chrono::milliseconds timeout;
+                    };
+                    std::unordered_map<std::string, async_tool> async_tools;
+                    std::map<std::string, std::shared_ptr<resource>> resources;
+
+                    // Maximum entries per tools/list or resources/list page, 0 returns everything at once
+                    size_t list_page_size = 100;
+
+                    // Whether tools/list and resources/list are the built-in handlers,
+                    // only then may their cached serialization be served directly
+                    bool builtin_tools_list = false;
+                    bool builtin_resources_list = false;
+                    mutable serialized_result tools_list_cache;
+                    mutable serialized_result resources_list_cache;
+                };
 
-                std::map<std::string, notification_handler> notification_handlers_;
+                copy_on_write<registry> registry_;
 
-                std::map<std::string, std::pair<tool, tool_handler>> tools_;
+                std::shared_ptr<const registry> registry_snapshot() const;
+
+                template<typename F>
+                void update_registry(F&& mutate);
 
                 auth_handler auth_handler_;
 
                 mutable std::mutex mutex_;
 
-                bool running_ = false;
+                std::atomic<bool> running_{false};
+
+                // How long stop() waits for in-flight handlers before closing the sessions
+                std::chrono::milliseconds shutdown_timeout_ = std::chrono::seconds(5);
 
                 thread_pool thread_pool_;
 
-                std::map<std::string, bool> session_initialized_;
+                size_t session_queue_depth_ = 256;
+
+                queue_overflow_policy session_overflow_policy_ = queue_overflow_policy::drop_oldest_heartbeat;
+
+                std::chrono::milliseconds session_send_timeout_ = std::chrono::seconds(5);
+
+                std::chrono::milliseconds session_idle_timeout_ = std::chrono::minutes(60);
+
+                size_t session_concurrency_ = 0;
+
+                // Admission limits of the message endpoint, read on every request so kept lock-free
+                std::atomic<size_t> max_queued_requests_{4096};
+                std::atomic<size_t> max_queued_per_session_{256};
+                std::atomic<size_t> max_bytes_in_flight_{64 * 1024 * 1024};
+
+                std::atomic<size_t> queued_requests_{0};
+                std::atomic<size_t> bytes_in_flight_{0};
+                std::atomic<uint64_t> rejected_requests_{0};
+
+                std::atomic<bool> streamable_http_{false};
+                std::atomic<std::chrono::milliseconds> inline_response_timeout_{std::chrono::seconds(60)};
+
+                // Accounting of one admitted request, given back when the task holding it is destroyed
+                struct admission_ticket;
+
+                // Count count requests against the limits, or fill res with 429/503 and return nullptr
+                std::shared_ptr<admission_ticket> admit_request(const std::shared_ptr<session>& target, size_t bytes, httplib::Response& res, size_t count = 1);
+
+                // A call of an async tool in flight, answered once by whichever comes first:
+                // the handler's result, a notifications/cancelled from the client or the deadline
+                struct async_call;
+
+                // Keyed by session id and request id, so notifications/cancelled finds the call it cancels
+                sharded_map<std::string, async_call> async_calls_;
+
+                // Start req if it calls an async tool, false to handle it like any other request
+                bool start_async_tool(const request& req, const std::shared_ptr<session>& target, const std::string& session_id, std::shared_ptr<admission_ticket> ticket);
+
+                // Send the response of call unless it has already been answered
+                void answer_async_call(async_call& call, const json& message);
+
+                void cancel_async_call(const std::string& session_id, const json& request_id);
+
+                // Cancel every async call of a session and forget it, never blocks
+                void cancel_session_async_calls(const std::string& session_id);
 
                 void handle_sse(const httplib::Request& req, httplib::Response& res);
 
@@ -230,38 +585,49 @@ namespace mcp {
 
                 json process_request(const request& req, const std::string& session_id);
 
-                json handle_initialize(const request& req, const std::string& session_id);
+                // Build a request from one JSON-RPC message, false if it is malformed
+                static bool parse_request(const json& message, request& out);
 
-                bool is_session_initialized(const std::string& session_id) const;
+                // Dispatch the elements of a JSON-RPC batch in parallel and answer with one SSE event
+                void handle_batch(const json& batch, const std::shared_ptr<session>& current_session, const std::string& session_id, size_t body_size, bool respond_inline, httplib::Response& res);
 
-                void sdet_session_initialized(const std::string& session_id, bool initialized);
+                // Whether the client of req takes the response in the POST body
+                static bool accepts_json(const httplib::Request& req);
 
-                std::string generate_session_id() const;
+                // Serialized JSON-RPC response for req, served from the registry cache when possible
+                std::string serialize_response(const request& req, const std::string& session_id);
+
+                // Process req and send the response over the session's SSE stream
+                void deliver_response(const request& req, const std::string& session_id, const std::shared_ptr<event_dispatcher>& dispatcher);
 
-                // 当T为左值引用类型时，t将被转换为T类型的左值
-                // 当T不是左值引用类型时，t将被转换为T类型的右值，这样就可以减少一次拷贝
-                // 因为在下面的模板中，只有传入左值的时候，才会发生拷贝
-                // 传入右值时，hadnler = std::forward<F>(handler)会走移动构造
+                // How an incoming message is scheduled
+                enum class dispatch_class {
+                    // Cheap built-in, handled on the connection thread
+                    inline_fast,
+                    // Control-plane call served by a user handler, high priority on the pool
+                    control,
+                    // Everything else, on the session lane
+                    normal
+                };
 
-                // std::async 是 C++ 标准库的异步函数模板
-                // 功能：在后台线程执行一个可调用对象（lambda、函数等），并返回一个 std::future，可以用来获取异步结果
+                static dispatch_class classify_request(const registry& reg, const request& req);
 
-                // [handler, params, session_id]
-                // 捕获外层 lambda 的三个变量，按值捕获（每个拷贝一份到新线程里）
+                // Run a queued message of target: control-plane calls at high priority on the pool,
+                // everything else, and everything of a limited session, on the session lane
+                void schedule_message(const std::shared_ptr<session>& target, dispatch_class route, std::function<void()> task);
 
-                // 这段代码写的真漂亮
-                // 这里不能写成 return [&handler](const json& params, const string& session_id)
-                // 因为这里涉及到异步，如果外部的lambda调用玩函数，那么handler局部变量可能被销毁
-                // 导致在异步线程中，找不到handler变量
-                // 所以这里必须要写拷贝，也就是 [handler = std::forward<F>(handler)]
-                template<typename F>
-                std::function<std::future<josn>(const json&, const std::string&)> make_async_handler(F&& handler) {
-                    return [handler = std::forward<F>(handler)](const json& params, const std::string& session_id) -> std::future<json> {
-                        return std::async(std::launch::async, [handler, params, session_id]() -> json {
-                            return handler(params, session_id);
-                        });
-                    };
-                };
+                // One page of the listing, starting after the entry encoded in cursor
+                static json build_tools_list(const registry& reg, const std::string& cursor = "");
+
+                static json build_resources_list(const registry& reg, const std::string& cursor = "");
+
+                json handle_initialize(const request& req, const std::string& session_id);
+
+                bool is_session_initialized(const std::string& session_id) const;
+
+                void set_session_initialized(const std::string& session_id, bool initialized);
+
+                std::string generate_session_id() const;
 
                 class auto_lock {
                     public:
@@ -275,12 +641,26 @@ namespace mcp {
                     return auto_lock(mutex_);
                 }
 
-                void check_inactive_sessions();
-                std::unique_ptr<std::thread> maintenance_thread_;
+                // Idle timer callback of a session, returns the delay until the next check or 0 once closed
+                std::chrono::milliseconds check_session_idle(const std::string& session_id, const std::shared_ptr<event_dispatcher>& dispatcher, std::chrono::milliseconds timeout);
 
                 std::map<std::string, session_cleanup_handler> session_cleanup_handler_;
 
                 void close_session(const std::string& session_id);
+
+                // Cancel the timers of a session, safe to call from several threads
+                void cancel_session_timers(session& s);
+
+                // Drives heartbeats and idle timeouts of all sessions from one thread.
+                // Declared after everything its callbacks use, so it is destroyed before them.
+                timer_wheel timers_;
+
+#if defined(__linux__)
+                // Writes the SSE streams once the connection thread has sent the response head, so an open
+                // stream does not hold one of httplib's connection threads. Declared last: closing the
+                // remaining streams on destruction closes their sessions, which cancels their timers.
+                std::unique_ptr<sse_reactor<event_dispatcher>> sse_reactor_;
+#endif
     };
 } // namespace mcp
 
@@ -0,0 +1,100 @@
+#ifndef MCP_SHARDED_MAP_H
+#define MCP_SHARDED_MAP_H
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <functional>
+
+namespace mcp {
+
+    // Concurrent hash map split into independently locked shards.
+    // Values are held by shared_ptr, so a looked-up value stays valid after the shard lock is released.
+    // Lookups take a shared lock on a single shard, so unrelated keys never contend.
+    template <typename Key, typename Value, size_t ShardCount = 32, typename Hash = std::hash<Key>>
+    class sharded_map {
+        public:
+            std::shared_ptr<Value> find(const Key& key) const {
+                const auto& s = shard_for(key);
+                std::shared_lock<std::shared_mutex> lock(s.mutex);
+                auto it = s.entries.find(key);
+                return it != s.entries.end() ? it->second : nullptr;
+            }
+
+            // Insert or replace the value of key
+            void insert(const Key& key, std::shared_ptr<Value> value) {
+                auto& s = shard_for(key);
+                std::unique_lock<std::shared_mutex> lock(s.mutex);
+                s.entries[key] = std::move(value);
+            }
+
+            // Remove key, returns the removed value or nullptr
+            std::shared_ptr<Value> erase(const Key& key) {
+                auto& s = shard_for(key);
+                std::unique_lock<std::shared_mutex> lock(s.mutex);
+                auto it = s.entries.find(key);
+                if (it == s.entries.end()) {
+                    return nullptr;
+                }
+                auto value = std::move(it->second);
+                s.entries.erase(it);
+                return value;
+            }
+
+            // Visit every entry, holding one shard lock at a time.
+            // The callback must not modify the map.
+            template <typename F>
+            void for_each(F&& f) const {
+                for (const auto& s : shards_) {
+                    std::shared_lock<std::shared_mutex> lock(s.mutex);
+                    for (const auto& [key, value] : s.entries) {
+                        f(key, value);
+                    }
+                }
+            }
+
+            // Remove every entry and hand the values back to the caller
+            std::vector<std::shared_ptr<Value>> take_all() {
+                std::vector<std::shared_ptr<Value>> values;
+                for (auto& s : shards_) {
+                    std::unique_lock<std::shared_mutex> lock(s.mutex);
+                    for (auto& [key, value] : s.entries) {
+                        values.push_back(std::move(value));
+                    }
+                    s.entries.clear();
+                }
+                return values;
+            }
+
+            size_t size() const {
+                size_t total = 0;
+                for (const auto& s : shards_) {
+                    std::shared_lock<std::shared_mutex> lock(s.mutex);
+                    total += s.entries.size();
+                }
+                return total;
+            }
+
+        private:
+            struct alignas(64) shard {
+                mutable std::shared_mutex mutex;
+                std::unordered_map<Key, std::shared_ptr<Value>, Hash> entries;
+            };
+
+            shard& shard_for(const Key& key) {
+                return shards_[Hash{}(key) % ShardCount];
+            }
+
+            const shard& shard_for(const Key& key) const {
+                return shards_[Hash{}(key) % ShardCount];
+            }
+
+            std::array<shard, ShardCount> shards_;
+    };
+
+} // namespace mcp
+
+#endif // MCP_SHARDED_MAP_H
@@ -5,6 +5,9 @@
 #include "mcp_mesesage.h"
 #include "mcp_tool.h"
 #include "mcp_logger.h"
+#include "mcp_pending_table.h"
+#include "mcp_sse_parser.h"
+#include "mcp_timer_wheel.h"
 
 #include "httplib.h"
 #include <map>
@@ -15,6 +18,7 @@
 #include <atomic>
 #include <condition_variable>
 #include <future>
+#include <string_view>
 
 namespace mcp {
 	class sse_client : public client {
@@ -36,21 +40,35 @@ namespace mcp {
 
 			void set_timeout(int timeout_seconds);
 
+			// Maximum number of requests waiting for a response at the same time, 0 for no limit (default 64).
+			// Blocking callers beyond the limit wait for a free slot for up to the request timeout,
+			// asynchronous ones fail right away.
+			void set_max_in_flight(size_t max_in_flight);
+
 			void set_capabilities(const json& capabilities) override;
 
 			response send_request(cionst std::string& method, const json& params = json::object()) override;
 
 			void send_notification(const std::string& method, const json& params = json::object()) override;
 
+			std::vector<response> send_batch(const std::vector<request>& requests) override;
+
+			// Returns after the POST. Fails right away with an error response when max_in_flight requests are
+			// outstanding, and with request_timeout when no response arrives within the request timeout.
+			void send_request_async(const std::string& method, const json& params, response_callback callback) override;
+			using client::send_request_async;
+
 			json get_server_capabilities() override;
 
 			json call_tool(const std::string& tool_name, const json& arguments = json::object()) override;
 
 			std::vector<tool> get_tools() override;
 
+			json list_tools(const std::string& cursor = "") override;
+
 			json get_capabilities() override;
 
-			json listresources(const std::string& cursor = "") override;
+			json list_resources(const std::string& cursor = "") override;
 
 			json read_resource(const std::string& resource_uri) override;
 
@@ -66,12 +84,78 @@ namespace mcp {
 
 			void open_sse_connection();
 
-			bool parse_sse_data(const char* data, size_t length);
+			// Handle one complete SSE event, the views point into the parser's buffer
+			void handle_sse_event(std::string_view event_type, std::string_view data);
 
 			void close_sse_connection();
 
 			json send_jsonrpc(const request& req);
 
+			// What a POST to the message endpoint needs, copied under mutex_ so the request runs without it
+			struct post_target {
+				std::string endpoint;
+				httplib::Headers headers;
+				int timeout_seconds = 30;
+			};
+
+			post_target prepare_post();
+
+			// Send req and register done to complete it, the in-flight slot is held until done has run.
+			// Throws if the request could not be sent, or if no slot is free and wait_for_slot is false.
+			void start_request(const request& req, completion done, bool wait_for_slot = true);
+
+			// Reserve up to count in-flight slots, throws if none frees up within the timeout (0 does not wait)
+			size_t acquire_in_flight(size_t count, int timeout_seconds);
+			void release_in_flight(size_t count);
+
+			// Borrows an HTTP client for one POST and hands it back to the pool afterwards
+			class pooled_client {
+				public:
+					explicit pooled_client(sse_client& owner);
+					~pooled_client();
+
+					pooled_client(const pooled_client&) = delete;
+					pooled_client& operator=(const pooled_client&) = delete;
+
+					httplib::Client* operator->() const {
+						return client_.get();
+					}
+
+				private:
+					sse_client& owner_;
+					std::unique_ptr<httplib::Client> client_;
+			};
+
+			std::unique_ptr<httplib::Client> acquire_post_client();
+			void release_post_client(std::unique_ptr<httplib::Client> client);
+
+			// Holds in-flight slots for its lifetime
+			class in_flight_slots {
+				public:
+					in_flight_slots(sse_client& owner, size_t count, int timeout_seconds);
+					~in_flight_slots();
+
+					in_flight_slots(const in_flight_slots&) = delete;
+					in_flight_slots& operator=(const in_flight_slots&) = delete;
+
+				private:
+					sse_client& owner_;
+					size_t count_;
+			};
+
+			// Complete the pending request a response or error message belongs to
+			void dispatch_response(const json& message);
+
+			completion take_pending(const json& id);
+
+			bool complete_pending(const json& id, const json& value);
+
+			// Complete every pending request with an error, e.g. when the connection closes
+			void fail_pending(const std::string& message);
+
+			// Complete pending requests answered directly in the body of their POST (streamable HTTP)
+			void dispatch_http_response(const httplib::Response& http_response);
+
 			std::string host_;
 			int port_ = 8080;
 
@@ -84,7 +168,12 @@ namespace mcp {
 			// 服务器在这个端点处理 JSON-RPC 请求
 			std::string msg_endpoint_;
 
-			std::unique_ptr<httplib::Client> http_client_;
+			// Clients for POSTs to the message endpoint. An httplib::Client sends one request at a time, and a
+			// streamable HTTP server keeps the POST open until the result is ready, so concurrent requests each
+			// borrow their own. Idle ones are kept for reuse, up to max_idle_post_clients.
+			std::vector<std::unique_ptr<httplib::Client>> idle_post_clients_;
+			std::mutex post_clients_mutex_;
+			static constexpr size_t max_idle_post_clients = 8;
 
 			std::unique_ptr<httplib::Client> sse_client_;
 
@@ -106,11 +195,20 @@ namespace mcp {
 
 			std::condition_variable endpoint_cv_;
 
-			std::map<json, std::promise<josn>> pending_requests_;
+			pending_table<completion> pending_requests_;
 
 			std::mutex response_mutex_;
 
 			std::condition_variable response_cv_;
+
+			// Requests waiting for a response and their limit
+			size_t in_flight_ = 0;
+			size_t max_in_flight_ = 64;
+			std::mutex in_flight_mutex_;
+			std::condition_variable in_flight_cv_;
+
+			// Deadlines of asynchronous requests, declared last so it is destroyed first
+			timer_wheel timers_;
 	};
 
 } // namespace mcp
@@ -0,0 +1,161 @@
+#ifndef MCP_SSE_PARSER_H
+#define MCP_SSE_PARSER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+namespace mcp {
+
+    // Incremental parser of a text/event-stream.
+    // Chunks are appended to one buffer and scanned from where the previous chunk stopped, so every byte
+    // is looked at once no matter how an event is split. Lines may end in CRLF, LF or CR and are never
+    // rewritten. Fields are kept as offsets into the buffer, and a single-line data field is handed to
+    // the callback as a view of the buffer without being copied.
+    class sse_parser {
+        public:
+            // Called once per complete event. The views are only valid during the call.
+            using event_callback = std::function<void(std::string_view event_type, std::string_view data)>;
+
+            explicit sse_parser(event_callback callback) : callback_(std::move(callback)) {}
+
+            void feed(const char* data, size_t length) {
+                buffer_.append(data, length);
+
+                while (scan_pos_ < buffer_.size()) {
+                    size_t end = buffer_.find_first_of("\r\n", scan_pos_);
+                    if (end == std::string::npos) {
+                        // Incomplete line, continue from here with the next chunk
+                        scan_pos_ = buffer_.size();
+                        break;
+                    }
+
+                    // CR at the end of the chunk may be the first half of a CRLF
+                    if (buffer_[end] == '\r' && end + 1 == buffer_.size()) {
+                        scan_pos_ = end;
+                        break;
+                    }
+
+                    size_t next = end + 1;
+                    if (buffer_[end] == '\r' && buffer_[next] == '\n') {
+                        ++next;
+                    }
+
+                    bool blank = end == line_start_;
+                    process_line(line_start_, end - line_start_);
+                    line_start_ = next;
+                    scan_pos_ = next;
+
+                    // Everything up to the blank line belongs to a dispatched event
+                    if (blank) {
+                        event_start_ = next;
+                    }
+                }
+
+                // Drop what has been fully processed. Only the unfinished event stays in the buffer, so
+                // an event arriving in many chunks is not moved around again and again.
+                if (event_start_ > 0) {
+                    buffer_.erase(0, event_start_);
+                    line_start_ -= event_start_;
+                    scan_pos_ -= event_start_;
+                    for (auto& field : data_lines_) {
+                        field.first -= event_start_;
+                    }
+                    if (has_event_type_) {
+                        event_type_.first -= event_start_;
+                    }
+                    event_start_ = 0;
+                }
+            }
+
+            // Forget any partial event, e.g. after a reconnect
+            void reset() {
+                buffer_.clear();
+                line_start_ = 0;
+                scan_pos_ = 0;
+                event_start_ = 0;
+                data_lines_.clear();
+                has_event_type_ = false;
+            }
+
+        private:
+            using span = std::pair<size_t, size_t>;
+
+            void process_line(size_t start, size_t length) {
+                // An empty line ends the event
+                if (length == 0) {
+                    dispatch();
+                    return ;
+                }
+
+                std::string_view line(buffer_.data() + start, length);
+
+                // Comment
+                if (line.front() == ':') {
+                    return ;
+                }
+
+                size_t colon = line.find(':');
+                std::string_view field = line.substr(0, colon);
+                size_t value_start = colon == std::string_view::npos ? length : colon + 1;
+                if (value_start < length && line[value_start] == ' ') {
+                    ++value_start;
+                }
+                span value{start + value_start, length - value_start};
+
+                if (field == "data") {
+                    data_lines_.push_back(value);
+                } else if (field == "event") {
+                    event_type_ = value;
+                    has_event_type_ = true;
+                }
+                // id and retry are not used by MCP
+            }
+
+            void dispatch() {
+                if (!data_lines_.empty()) {
+                    std::string_view event_type = has_event_type_
+                        ? std::string_view(buffer_.data() + event_type_.first, event_type_.second)
+                        : std::string_view("message");
+
+                    if (data_lines_.size() == 1) {
+                        callback_(event_type, std::string_view(buffer_.data() + data_lines_[0].first, data_lines_[0].second));
+                    } else {
+                        // Several data lines are joined with newlines, the only case that copies
+                        joined_.clear();
+                        for (size_t i = 0; i < data_lines_.size(); ++i) {
+                            if (i > 0) {
+                                joined_ += '\n';
+                            }
+                            joined_.append(buffer_, data_lines_[i].first, data_lines_[i].second);
+                        }
+                        callback_(event_type, joined_);
+                    }
+                }
+
+                data_lines_.clear();
+                has_event_type_ = false;
+            }
+
+            event_callback callback_;
+
+            std::string buffer_;
+            // Start of the line being scanned, where scanning resumes, and start of the unfinished event
+            size_t line_start_ = 0;
+            size_t scan_pos_ = 0;
+            size_t event_start_ = 0;
+
+            // Fields of the unfinished event as (offset, length) in buffer_
+            std::vector<span> data_lines_;
+            span event_type_{0, 0};
+            bool has_event_type_ = false;
+
+            std::string joined_;
+    };
+
+} // namespace mcp
+
+#endif // MCP_SSE_PARSER_H
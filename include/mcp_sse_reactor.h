@@ -0,0 +1,420 @@
+#ifndef MCP_SSE_REACTOR_H
+#define MCP_SSE_REACTOR_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <atomic>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace mcp {
+
+#if defined(__linux__)
+
+    // Event loops that hold SSE streams as non-blocking sockets instead of parking a thread on each.
+    // The HTTP server writes the response head and hands the socket over. From then on an idle stream
+    // costs a file descriptor: it is written when its source has events and the socket takes them, as
+    // one HTTP chunk per wake-up, and closed when the peer goes away or the source is closed and drained.
+    //
+    // Source provides
+    //   bool take_events(std::string& out)                      append what is queued, false once closed
+    //   void set_ready_handler(std::function<void()> handler)   run when events arrive or it closes
+    //   void update_activity()
+    template <typename Source>
+    class sse_reactor {
+        public:
+            // Called once the stream is gone, on the loop thread. It must not block, every stream of the loop waits for it.
+            using close_callback = std::function<void()>;
+
+            explicit sse_reactor(size_t loops = 1) {
+                if (loops == 0) {
+                    loops = 1;
+                }
+                for (size_t i = 0; i < loops; ++i) {
+                    auto l = std::make_unique<loop>();
+                    l->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+                    l->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                    if (l->epoll_fd < 0 || l->wake_fd < 0) {
+                        close_loop_fds(*l);
+                        stop();
+                        throw std::runtime_error("Failed to create SSE event loop");
+                    }
+
+                    // id 0 is the wake-up descriptor, streams count from 1
+                    epoll_event ev{};
+                    ev.events = EPOLLIN;
+                    ev.data.u64 = 0;
+                    epoll_ctl(l->epoll_fd, EPOLL_CTL_ADD, l->wake_fd, &ev);
+
+                    loop* raw = l.get();
+                    l->thread = std::thread([this, raw] { run(*raw); });
+                    loops_.push_back(std::move(l));
+                }
+            }
+
+            ~sse_reactor() {
+                stop();
+            }
+
+            sse_reactor(const sse_reactor&) = delete;
+            sse_reactor& operator=(const sse_reactor&) = delete;
+
+            // Take over fd, a connected socket whose response head has been written.
+            // Returns false if the reactor is stopped, then the caller still owns fd.
+            bool add(int fd, std::shared_ptr<Source> source, close_callback on_close) {
+                if (stopped_.load(std::memory_order_acquire) || loops_.empty()) {
+                    return false;
+                }
+
+                int flags = fcntl(fd, F_GETFL, 0);
+                if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+                    return false;
+                }
+
+                loop& l = *loops_[next_loop_.fetch_add(1, std::memory_order_relaxed) % loops_.size()];
+                auto s = std::make_shared<stream>();
+                s->fd = fd;
+                s->id = next_id_.fetch_add(1, std::memory_order_relaxed);
+                s->source = std::move(source);
+                s->on_close = std::move(on_close);
+
+                // Registered by the loop thread, so everything that happens to a stream happens on one thread
+                {
+                    std::lock_guard<std::mutex> lock(l.mutex);
+                    if (l.stopping) {
+                        return false;
+                    }
+                    l.streams[s->id] = s;
+                    l.added.push_back(s);
+                }
+                stream_count_.fetch_add(1, std::memory_order_relaxed);
+                wake(l);
+                return true;
+            }
+
+            // Close every stream and join the loops, nothing is added afterwards
+            void stop() {
+                if (stopped_.exchange(true)) {
+                    return ;
+                }
+                for (auto& l : loops_) {
+                    {
+                        std::lock_guard<std::mutex> lock(l->mutex);
+                        l->stopping = true;
+                    }
+                    wake(*l);
+                }
+                for (auto& l : loops_) {
+                    if (l->thread.joinable()) {
+                        l->thread.join();
+                    }
+                    close_loop_fds(*l);
+                }
+            }
+
+            // Number of streams the loops are holding
+            size_t stream_count() const {
+                return stream_count_.load(std::memory_order_relaxed);
+            }
+
+        private:
+            struct stream {
+                int fd = -1;
+                uint64_t id = 0;
+                std::shared_ptr<Source> source;
+                close_callback on_close;
+                // Framed bytes not yet taken by the socket
+                std::string out;
+                size_t written = 0;
+                // The terminating chunk is in out, the stream closes once it is written
+                bool ending = false;
+                // EPOLLOUT is armed
+                bool waiting_writable = false;
+                bool closed = false;
+            };
+
+            struct loop {
+                int epoll_fd = -1;
+                int wake_fd = -1;
+                std::thread thread;
+                std::mutex mutex;
+                // Streams whose source has something new, guarded by mutex
+                std::vector<std::shared_ptr<stream>> ready;
+                // Streams handed over and not registered with epoll yet, guarded by mutex
+                std::vector<std::shared_ptr<stream>> added;
+                std::unordered_map<uint64_t, std::shared_ptr<stream>> streams;
+                bool stopping = false;
+                // Reused by the loop thread across flushes
+                std::string payload;
+            };
+
+            // Runs under the source's lock, so it only queues the stream and wakes the loop
+            void notify(loop& l, const std::weak_ptr<stream>& weak) {
+                auto s = weak.lock();
+                if (!s) {
+                    return ;
+                }
+                bool was_empty;
+                {
+                    std::lock_guard<std::mutex> lock(l.mutex);
+                    was_empty = l.ready.empty();
+                    l.ready.push_back(std::move(s));
+                }
+                // The loop empties the list after reading the eventfd, one wake-up covers the whole list
+                if (was_empty) {
+                    wake(l);
+                }
+            }
+
+            static void wake(loop& l) {
+                uint64_t one = 1;
+                ssize_t ignored = write(l.wake_fd, &one, sizeof(one));
+                (void)ignored;
+            }
+
+            static void close_loop_fds(loop& l) {
+                if (l.epoll_fd >= 0) {
+                    ::close(l.epoll_fd);
+                    l.epoll_fd = -1;
+                }
+                if (l.wake_fd >= 0) {
+                    ::close(l.wake_fd);
+                    l.wake_fd = -1;
+                }
+            }
+
+            void run(loop& l) {
+                std::vector<epoll_event> events(256);
+                bool stopping = false;
+                while (!stopping) {
+                    int n = epoll_wait(l.epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+                    if (n < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        break;
+                    }
+
+                    for (int i = 0; i < n; ++i) {
+                        if (events[i].data.u64 == 0) {
+                            uint64_t count;
+                            ssize_t ignored = read(l.wake_fd, &count, sizeof(count));
+                            (void)ignored;
+                            continue;
+                        }
+
+                        std::shared_ptr<stream> s;
+                        {
+                            std::lock_guard<std::mutex> lock(l.mutex);
+                            auto it = l.streams.find(events[i].data.u64);
+                            if (it == l.streams.end()) {
+                                continue;
+                            }
+                            s = it->second;
+                        }
+
+                        uint32_t flags = events[i].events;
+                        if ((flags & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) || ((flags & EPOLLIN) && !drain_input(*s))) {
+                            close_stream(l, *s);
+                        } else if (flags & EPOLLOUT) {
+                            flush(l, *s);
+                        }
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock(l.mutex);
+                        stopping = l.stopping;
+                    }
+                    // Read after stopping, so whatever was queued before stop() is flushed once more
+                    register_added(l);
+                    flush_ready(l);
+                }
+
+                // Shut down: close what is left
+                std::vector<std::shared_ptr<stream>> remaining;
+                {
+                    std::lock_guard<std::mutex> lock(l.mutex);
+                    for (auto& entry : l.streams) {
+                        remaining.push_back(entry.second);
+                    }
+                }
+                for (auto& s : remaining) {
+                    close_stream(l, *s);
+                }
+            }
+
+            void register_added(loop& l) {
+                std::vector<std::shared_ptr<stream>> added;
+                {
+                    std::lock_guard<std::mutex> lock(l.mutex);
+                    added.swap(l.added);
+                }
+                for (auto& s : added) {
+                    epoll_event ev{};
+                    ev.events = EPOLLIN | EPOLLRDHUP;
+                    ev.data.u64 = s->id;
+                    if (epoll_ctl(l.epoll_fd, EPOLL_CTL_ADD, s->fd, &ev) < 0) {
+                        close_stream(l, *s);
+                        continue;
+                    }
+
+                    // Events queued before the handler was installed are picked up by this first flush
+                    std::weak_ptr<stream> weak = s;
+                    s->source->set_ready_handler([this, &l, weak] { notify(l, weak); });
+                    flush(l, *s);
+                }
+            }
+
+            void flush_ready(loop& l) {
+                std::vector<std::shared_ptr<stream>> ready;
+                {
+                    std::lock_guard<std::mutex> lock(l.mutex);
+                    ready.swap(l.ready);
+                }
+                for (auto& s : ready) {
+                    flush(l, *s);
+                }
+            }
+
+            // The client sends nothing after its GET, read and drop whatever arrives.
+            // False once the peer has closed its side or the socket failed.
+            static bool drain_input(stream& s) {
+                char buffer[1024];
+                while (true) {
+                    ssize_t n = recv(s.fd, buffer, sizeof(buffer), 0);
+                    if (n > 0) {
+                        continue;
+                    }
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+                }
+            }
+
+            // Write as much as the socket takes, pulling the next chunk from the source once the
+            // previous one is out. A full socket arms EPOLLOUT, the source keeps queueing meanwhile.
+            void flush(loop& l, stream& s) {
+                while (!s.closed) {
+                    if (s.written == s.out.size()) {
+                        s.out.clear();
+                        s.written = 0;
+                        if (s.ending) {
+                            close_stream(l, s);
+                            return ;
+                        }
+
+                        l.payload.clear();
+                        bool open = s.source->take_events(l.payload);
+                        if (!l.payload.empty()) {
+                            char size_line[24];
+                            int length = std::snprintf(size_line, sizeof(size_line), "%zx\r\n", l.payload.size());
+                            s.out.reserve(length + l.payload.size() + 2);
+                            s.out.append(size_line, length);
+                            s.out.append(l.payload);
+                            s.out.append("\r\n");
+                            s.source->update_activity();
+                        }
+                        if (!open) {
+                            s.out.append("0\r\n\r\n");
+                            s.ending = true;
+                        }
+                        if (s.out.empty()) {
+                            break;
+                        }
+                    }
+
+                    ssize_t n = send(s.fd, s.out.data() + s.written, s.out.size() - s.written, MSG_NOSIGNAL);
+                    if (n > 0) {
+                        s.written += static_cast<size_t>(n);
+                        continue;
+                    }
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        set_waiting_writable(l, s, true);
+                        return ;
+                    }
+                    close_stream(l, s);
+                    return ;
+                }
+
+                if (!s.closed) {
+                    set_waiting_writable(l, s, false);
+                }
+            }
+
+            static void set_waiting_writable(loop& l, stream& s, bool waiting) {
+                if (s.waiting_writable == waiting) {
+                    return ;
+                }
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLRDHUP | (waiting ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+                ev.data.u64 = s.id;
+                epoll_ctl(l.epoll_fd, EPOLL_CTL_MOD, s.fd, &ev);
+                s.waiting_writable = waiting;
+            }
+
+            void close_stream(loop& l, stream& s) {
+                if (s.closed) {
+                    return ;
+                }
+                s.closed = true;
+
+                epoll_ctl(l.epoll_fd, EPOLL_CTL_DEL, s.fd, nullptr);
+                shutdown(s.fd, SHUT_RDWR);
+                ::close(s.fd);
+
+                // Takes the source's lock, after it returns the source no longer calls notify
+                s.source->set_ready_handler(nullptr);
+
+                // Keep the stream alive until the callback has run, the map may hold the last reference
+                std::shared_ptr<stream> keep;
+                {
+                    std::lock_guard<std::mutex> lock(l.mutex);
+                    auto it = l.streams.find(s.id);
+                    if (it != l.streams.end()) {
+                        keep = std::move(it->second);
+                        l.streams.erase(it);
+                    }
+                }
+                stream_count_.fetch_sub(1, std::memory_order_relaxed);
+
+                close_callback on_close = std::move(s.on_close);
+                if (on_close) {
+                    try {
+                        on_close();
+                    } catch (...) {
+                        // The stream is gone either way
+                    }
+                }
+            }
+
+            std::vector<std::unique_ptr<loop>> loops_;
+            std::atomic<size_t> next_loop_{0};
+            std::atomic<uint64_t> next_id_{1};
+            std::atomic<size_t> stream_count_{0};
+            std::atomic<bool> stopped_{false};
+    };
+
+#endif // __linux__
+
+} // namespace mcp
+
+#endif // MCP_SSE_REACTOR_H
@@ -5,6 +5,8 @@
 #include "mcp_message.h"
 #include "mcp_tool.h"
 #include "mcp_logger.h"
+#include "mcp_pending_table.h"
+#include "mcp_timer_wheel.h"
 
 #include <string>
 #include <map>
@@ -15,6 +17,7 @@
 #include <condition_variable>
 #include <future>
 #include <thread>
+#include <atomic>
 
 namespace mcp {
     class stdio_client : public client {
@@ -37,11 +40,18 @@ namespace mcp {
 
         void send_notification(const std::string& method, const json& params = json::object()) override;
 
+        std::vector<response> send_batch(const std::vector<request>& requests) override;
+
+        void send_request_async(const std::string& method, const json& params, response_callback callback) override;
+        using client::send_request_async;
+
         json get_server_capabillities() override;
 
         json call_tool(const std::string& tool_name, const json& arguments = json::object()) override;
 
         std::vector<tool> get_tools() override;
+
+        json list_tools(const std::string& cursor = "") override;
         
         json get_capabilities() override;
 
@@ -63,8 +73,26 @@ namespace mcp {
 
         void read_thread_func();
 
+        void close_wake_pipe();
+
         json send_jsonrpc(const request& req);
 
+        // Write a whole line to the server's stdin, false if the pipe failed
+        bool write_line(const std::string& line);
+
+        // Register done for req and write it to the server, throws if the write fails
+        void start_request(const request& req, completion done);
+
+        // Complete the pending request a response belongs to
+        void dispatch_message(const json& message);
+
+        completion take_pending(const json& id);
+
+        bool complete_pending(const json& id, const json& value);
+
+        // Complete every pending request with an error, e.g. when the server exits
+        void fail_pending(const std::string& message);
+
         std::string command_;
 
         int process_id_ = -1;
@@ -73,6 +101,9 @@ namespace mcp {
 
         int stdout_pipe_[2] = {-1, -1};
 
+        // Written by stop_server_process to wake the read thread out of poll()
+        int wake_pipe_[2] = {-1, -1};
+
         std::unique_ptr<std::thread> read_thread_;
 
         std::atomic<bool> running_{false};
@@ -83,15 +114,25 @@ namespace mcp {
 
         mutable std::mutex mutex_;
 
-        std::map<json, std::promise<json>> pending_requests_;
+        pending_table<completion> pending_requests_;
 
         std::mutex response_mutex_;
 
+        // Serializes writes to the server's stdin, so messages from concurrent senders never interleave
+        std::mutex write_mutex_;
+
+        // Set under response_mutex_ once the read thread has stopped. Nothing would answer a request
+        // registered after that, so new requests are rejected instead.
+        bool reader_stopped_ = false;
+
         std::atomic<bool> initialized_{false};
 
         std::condition_variable init_cv_;
 
         json env_vers_;
+
+        // Deadlines of asynchronous requests, declared last so it is destroyed first
+        timer_wheel timers_;
     };
 } // namespace mcp
 
@@ -2,62 +2,157 @@
 #define MCP_THREAD_POOL_H
 
 #include <vector>
-#include <queue>
+#include <deque>
+#include <memory>
 #include <thread>
 #include <mutex>
-#include <condition>
+#include <condition_variable>
 #include <functional>
 #include <future>
 #include <atomic>
+#include <stdexcept>
 #include <type_traits>
+#include <chrono>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace mcp {
-    
-    class thread_pool {
+
+    // Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design).
+    // Used as the injection queue through which non-worker threads hand tasks to the pool.
+    template <typename T>
+    class mpmc_queue {
         public:
-            explicit thread_pool(size_t num_threads = std::thread::hardware_concurrency()) : stop_(false) {
-                for (size_t i = 0; i < num_threads; ++i) {
-                    workers_.emplace_back([this] {
-                        while (true) {
-                            std::function<void()> task;
+            explicit mpmc_queue(size_t capacity) {
+                // Round the capacity up to a power of two so the index can be masked
+                size_t size = 2;
+                while (size < capacity) {
+                    size <<= 1;
+                }
+                mask_ = size - 1;
+                cells_ = std::make_unique<cell[]>(size);
+                for (size_t i = 0; i < size; ++i) {
+                    cells_[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
 
-                            {
-                                std::unique_lock<std::mutex> lock(queue_mutex_);
-                                condition_.wait(lock, [this] {
-                                    return stop_ || !tasks_.empty();
-                                });
+            mpmc_queue(const mpmc_queue&) = delete;
+            mpmc_queue& operator=(const mpmc_queue&) = delete;
 
-                                if (stop_ && tasks_.empty()) {
-                                    return ;
-                                }
+            bool try_push(T&& value) {
+                size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+                cell* c;
+                while (true) {
+                    c = &cells_[pos & mask_];
+                    size_t seq = c->sequence.load(std::memory_order_acquire);
+                    intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                    if (diff == 0) {
+                        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            break;
+                        }
+                    } else if (diff < 0) {
+                        return false; // Full
+                    } else {
+                        pos = enqueue_pos_.load(std::memory_order_relaxed);
+                    }
+                }
 
-                                task = std::move(tasks_.front());
-                                tasks_.pop();
-                            }
+                c->value = std::move(value);
+                c->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
 
-                            task();
+            bool try_pop(T& value) {
+                size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+                cell* c;
+                while (true) {
+                    c = &cells_[pos & mask_];
+                    size_t seq = c->sequence.load(std::memory_order_acquire);
+                    intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+                    if (diff == 0) {
+                        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            break;
                         }
+                    } else if (diff < 0) {
+                        return false; // Empty
+                    } else {
+                        pos = dequeue_pos_.load(std::memory_order_relaxed);
+                    }
+                }
+
+                value = std::move(c->value);
+                c->sequence.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+
+        private:
+            struct cell {
+                std::atomic<size_t> sequence;
+                T value;
+            };
+
+            std::unique_ptr<cell[]> cells_;
+            size_t mask_ = 0;
+            alignas(64) std::atomic<size_t> enqueue_pos_{0};
+            alignas(64) std::atomic<size_t> dequeue_pos_{0};
+    };
+
+    // Scheduling class of a pool task
+    enum class task_priority {
+        // Regular work such as tool calls
+        normal,
+        // Short control-plane work, picked up before any normal task
+        high
+    };
+
+    // Work-stealing thread pool.
+    // Each worker owns a deque: tasks enqueued from a worker go to the back of its own deque and are
+    // popped LIFO for cache locality, idle workers steal from the front of the others. Tasks from
+    // outside the pool go through a lock-free injection queue, so submitters do not share one mutex.
+    class thread_pool {
+        public:
+            explicit thread_pool(size_t num_threads = std::thread::hardware_concurrency(), bool pin_threads = false)
+                : injection_queue_(1024), high_priority_queue_(256), stop_(false) {
+                if (num_threads == 0) {
+                    num_threads = 1;
+                }
+
+                queues_.reserve(num_threads);
+                for (size_t i = 0; i < num_threads; ++i) {
+                    queues_.push_back(std::make_unique<worker_queue>());
+                }
+
+                for (size_t i = 0; i < num_threads; ++i) {
+                    workers_.emplace_back([this, i] {
+                        worker_loop(i);
                     });
+
+                    if (pin_threads) {
+                        pin_to_core(workers_.back(), i);
+                    }
                 }
             }
 
             ~thread_pool() {
                 {
-                    std::unique_lock<std::mutex> lock(queue_mutex_);
+                    std::unique_lock<std::mutex> lock(sleep_mutex_);
                     stop_ = true;
                 }
 
-                condition_.notify_all();
+                sleep_cv_.notify_all();
 
                 for (std::thread& worker : workers_) {
-                    if (wokrer.joinable()) {
+                    if (worker.joinable()) {
                         worker.join();
                     }
                 }
             }
 
             template <class F, class... Args>
-            auto enqueue(F** f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type> {
+            auto enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type> {
                 using return_type = typename std::invoke_result<F, Args...>::type;
 
                 auto task = std::make_shared<std::packaged_task<return_type()>> (
@@ -66,35 +161,294 @@ namespace mcp {
 
                 std::future<return_type> result = task->get_future();
 
+                if (stop_) {
+                    throw std::runtime_error("Thread pool stopped, cannot add task");
+                }
+
+                push([task]() { (*task)(); });
+                return result;
+            }
+
+            // Fire-and-forget task without a future. It always goes through a shared FIFO queue,
+            // even from a worker, so it cannot jump ahead of work submitted by others.
+            // High priority tasks are taken by the next free worker before any normal task.
+            void post(std::function<void()> task, task_priority priority = task_priority::normal) {
+                if (stop_) {
+                    throw std::runtime_error("Thread pool stopped, cannot add task");
+                }
+
+                push(std::move(task), false, priority);
+            }
+
+            // Number of tasks queued but not yet picked up by a worker
+            size_t pending_tasks() const {
+                return pending_.load(std::memory_order_relaxed);
+            }
+
+            size_t size() const {
+                return workers_.size();
+            }
+
+            // Block until every queued and running task has finished or timeout has elapsed.
+            // Returns true if the pool drained. Tasks may still be enqueued meanwhile.
+            bool wait_idle(std::chrono::milliseconds timeout) {
+                std::unique_lock<std::mutex> lock(sleep_mutex_);
+                return drained_cv_.wait_for(lock, timeout, [this] {
+                    return pending_.load(std::memory_order_seq_cst) == 0 && active_.load(std::memory_order_seq_cst) == 0;
+                });
+            }
+
+        private:
+            using task_type = std::function<void()>;
+
+            struct alignas(64) worker_queue {
+                std::mutex mutex;
+                std::deque<task_type> tasks;
+            };
+
+            void push(task_type task, bool allow_local = true, task_priority priority = task_priority::normal) {
+                // Count the task before publishing it so pending_ never goes negative
+                pending_.fetch_add(1, std::memory_order_seq_cst);
+
+                // try_push only consumes the task on success, when the high priority queue is full
+                // the task takes the normal path
+                bool published = priority == task_priority::high && high_priority_queue_.try_push(std::move(task));
+
+                if (published) {
+                    // Already queued
+                } else if (allow_local && current_pool_ == this) {
+                    // Called from one of our workers, keep the task local
+                    auto& queue = *queues_[current_index_];
+                    std::lock_guard<std::mutex> lock(queue.mutex);
+                    queue.tasks.push_back(std::move(task));
+                } else if (!injection_queue_.try_push(std::move(task))) {
+                    // Injection queue is full, fall back to the locked overflow queue
+                    std::lock_guard<std::mutex> lock(overflow_mutex_);
+                    overflow_.push_back(std::move(task));
+                }
+
+                // Only pay for the wake-up when somebody is actually sleeping
+                if (idle_.load(std::memory_order_seq_cst) > 0) {
+                    std::lock_guard<std::mutex> lock(sleep_mutex_);
+                    sleep_cv_.notify_one();
+                }
+            }
+
+            bool try_pop(size_t index, task_type& task) {
+                // 0. High priority tasks go first
+                if (high_priority_queue_.try_pop(task)) {
+                    return true;
+                }
+
+                // 1. Own deque, newest first
                 {
-                    std::unique_lock<std::mutex> lock(queue_mutex_);
+                    auto& queue = *queues_[index];
+                    std::lock_guard<std::mutex> lock(queue.mutex);
+                    if (!queue.tasks.empty()) {
+                        task = std::move(queue.tasks.back());
+                        queue.tasks.pop_back();
+                        return true;
+                    }
+                }
+
+                // 2. Tasks submitted from outside the pool
+                if (injection_queue_.try_pop(task)) {
+                    return true;
+                }
 
-                    if (stop_) {
-                        throw std::runtime_error("Thread pool stopped, cannot add task");
+                {
+                    std::lock_guard<std::mutex> lock(overflow_mutex_);
+                    if (!overflow_.empty()) {
+                        task = std::move(overflow_.front());
+                        overflow_.pop_front();
+                        return true;
                     }
+                }
 
-                    tasks_.emplace([task]() {(*task)(); });
+                // 3. Steal the oldest task of another worker
+                for (size_t offset = 1; offset < queues_.size(); ++offset) {
+                    auto& victim = *queues_[(index + offset) % queues_.size()];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (!victim.tasks.empty()) {
+                        task = std::move(victim.tasks.front());
+                        victim.tasks.pop_front();
+                        return true;
+                    }
                 }
 
-                condition_.notify_one();
-                return result;
+                return false;
             }
-        
-        private:
+
+            void worker_loop(size_t index) {
+                current_pool_ = this;
+                current_index_ = index;
+
+                while (true) {
+                    task_type task;
+
+                    if (try_pop(index, task)) {
+                        // Count the task as running before it stops counting as queued, so a drain never sees both at zero
+                        active_.fetch_add(1, std::memory_order_seq_cst);
+                        pending_.fetch_sub(1, std::memory_order_seq_cst);
+                        task();
+
+                        // Last running task with nothing queued, wake up wait_idle()
+                        if (active_.fetch_sub(1, std::memory_order_seq_cst) == 1 && pending_.load(std::memory_order_seq_cst) == 0) {
+                            std::lock_guard<std::mutex> lock(sleep_mutex_);
+                            drained_cv_.notify_all();
+                        }
+                        continue;
+                    }
+
+                    std::unique_lock<std::mutex> lock(sleep_mutex_);
+                    idle_.fetch_add(1, std::memory_order_seq_cst);
+                    sleep_cv_.wait(lock, [this] {
+                        return stop_ || pending_.load(std::memory_order_seq_cst) > 0;
+                    });
+                    idle_.fetch_sub(1, std::memory_order_relaxed);
+
+                    if (stop_ && pending_.load(std::memory_order_acquire) == 0) {
+                        return ;
+                    }
+                }
+            }
+
+            static void pin_to_core(std::thread& thread, size_t index) {
+#if defined(__linux__)
+                unsigned int cores = std::thread::hardware_concurrency();
+                if (cores == 0) {
+                    return ;
+                }
+
+                cpu_set_t cpuset;
+                CPU_ZERO(&cpuset);
+                CPU_SET(index % cores, &cpuset);
+                pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset);
+#else
+                (void)thread;
+                (void)index;
+#endif
+            }
+
             // Worker threads
             std::vector<std::thread> workers_;
 
-            // Task queue
-            std::queue<std::functino<void()>> tasks_;
+            // Per-worker task deques
+            std::vector<std::unique_ptr<worker_queue>> queues_;
+
+            // Lock-free queue for tasks from non-worker threads, and its overflow
+            mpmc_queue<task_type> injection_queue_;
+            std::mutex overflow_mutex_;
+            std::deque<task_type> overflow_;
+
+            // Lock-free queue for high priority tasks
+            mpmc_queue<task_type> high_priority_queue_;
 
-            // Mutex and condition variable
-            std::mutex queue_mutex_;
-            std::condition_variable condition_;
+            // Queued task count, running task count and number of sleeping workers
+            std::atomic<size_t> pending_{0};
+            std::atomic<size_t> active_{0};
+            std::atomic<size_t> idle_{0};
+
+            // Mutex and condition variable for idle workers, and for wait_idle()
+            std::mutex sleep_mutex_;
+            std::condition_variable sleep_cv_;
+            std::condition_variable drained_cv_;
 
             // Stop flag
             std::atomic<bool> stop_;
+
+            // Pool and worker index of the calling thread, if it is a worker
+            inline static thread_local thread_pool* current_pool_ = nullptr;
+            inline static thread_local size_t current_index_ = 0;
+    };
+
+    // Serial lane (strand) of tasks on a shared thread_pool.
+    // Tasks posted to one lane start in posting order and at most max_concurrency of them run at once,
+    // with 1 they run strictly one after another. A lane never holds more than max_concurrency pool slots
+    // and hands its slot back to the pool's FIFO queue after every task, so lanes with work take turns
+    // round-robin and a lane with a long backlog cannot push other lanes' tasks behind it.
+    // 0 caps a lane at the pool's thread count only, it still takes turns with the other lanes.
+    // Lanes must be created with std::make_shared.
+    class task_lane : public std::enable_shared_from_this<task_lane> {
+        public:
+            explicit task_lane(thread_pool& pool, size_t max_concurrency = 1)
+                : pool_(pool), max_concurrency_(max_concurrency == 0 ? pool.size() : max_concurrency) {}
+
+            task_lane(const task_lane&) = delete;
+            task_lane& operator=(const task_lane&) = delete;
+
+            void post(std::function<void()> task) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    tasks_.push_back(std::move(task));
+                    if (running_ >= max_concurrency_) {
+                        // A running slot picks it up when it finishes
+                        return ;
+                    }
+                    ++running_;
+                }
+
+                schedule();
+            }
+
+            // Tasks posted but not yet started
+            size_t queued() const {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return tasks_.size();
+            }
+
+        private:
+            void schedule() {
+                auto self = shared_from_this();
+                try {
+                    pool_.post([self]() { self->run_one(); });
+                } catch (...) {
+                    // Pool is stopping, give the slot back
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    --running_;
+                }
+            }
+
+            void run_one() {
+                std::function<void()> task;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (tasks_.empty()) {
+                        // Another slot of this lane already took the task this slot was rescheduled for
+                        --running_;
+                        return ;
+                    }
+                    task = std::move(tasks_.front());
+                    tasks_.pop_front();
+                }
+
+                try {
+                    task();
+                } catch (...) {
+                    // Lane tasks report their own errors, one failure must not stall the lane
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (tasks_.empty()) {
+                        --running_;
+                        return ;
+                    }
+                }
+
+                // Requeue behind everybody else's work instead of running the next task right away
+                schedule();
+            }
+
+            thread_pool& pool_;
+            const size_t max_concurrency_;
+
+            mutable std::mutex mutex_;
+            std::deque<std::function<void()>> tasks_;
+            // Pool slots currently held by this lane
+            size_t running_ = 0;
     };
 
 } // namespace mcp
 
-#endif // MCP_THREAD_POOL_H
\ No newline at end of file
+#endif // MCP_THREAD_POOL_H
@@ -0,0 +1,232 @@
+#ifndef MCP_TIMER_WHEEL_H
+#define MCP_TIMER_WHEEL_H
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+namespace mcp {
+
+    // Hashed timing wheel driven by a single thread.
+    // Timers are hashed into slots by expiry tick; timers further out than one
+    // revolution carry a round counter. Scheduling and cancelling are O(1) on
+    // average, and an idle timer costs one list node instead of a sleeping thread.
+    class timer_wheel {
+        public:
+            using timer_id = uint64_t;
+
+            // Periodic callback, return true to be re-armed after the interval
+            using periodic_callback = std::function<bool()>;
+
+            // Callback that picks its own next delay, return 0 to stop
+            using adaptive_callback = std::function<std::chrono::milliseconds()>;
+
+            explicit timer_wheel(std::chrono::milliseconds tick = std::chrono::milliseconds(100), size_t slots = 512)
+                : tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)), slots_(slots == 0 ? 1 : slots) {
+                next_tick_ = std::chrono::steady_clock::now() + tick_;
+                thread_ = std::thread([this] { run(); });
+            }
+
+            ~timer_wheel() {
+                stop();
+            }
+
+            timer_wheel(const timer_wheel&) = delete;
+            timer_wheel& operator=(const timer_wheel&) = delete;
+
+            // Run callback once after delay
+            timer_id schedule(std::chrono::milliseconds delay, std::function<void()> callback) {
+                return schedule_adaptive(delay, [callback = std::move(callback)]() {
+                    callback();
+                    return std::chrono::milliseconds(0);
+                });
+            }
+
+            // Run callback after delay, then every interval for as long as it returns true
+            timer_id schedule_every(std::chrono::milliseconds delay, std::chrono::milliseconds interval, periodic_callback callback) {
+                return schedule_adaptive(delay, [interval, callback = std::move(callback)]() {
+                    return callback() ? interval : std::chrono::milliseconds(0);
+                });
+            }
+
+            // Run callback after delay, then again after whatever delay it returns.
+            // Useful for deadlines that move, e.g. an idle timeout that is pushed back by activity.
+            timer_id schedule_adaptive(std::chrono::milliseconds delay, adaptive_callback callback) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                timer_id id = next_id_++;
+                insert(entry{id, 0, std::chrono::milliseconds(0), std::move(callback)}, delay);
+                return id;
+            }
+
+            // Cancel a timer. A callback that is already running completes but is not re-armed.
+            bool cancel(timer_id id) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = index_.find(id);
+                if (it == index_.end()) {
+                    return false;
+                }
+
+                size_t slot = it->second;
+                index_.erase(it);
+
+                if (slot == in_flight) {
+                    return true;
+                }
+
+                auto& bucket = slots_[slot];
+                for (auto entry_it = bucket.begin(); entry_it != bucket.end(); ++entry_it) {
+                    if (entry_it->id == id) {
+                        bucket.erase(entry_it);
+                        break;
+                    }
+                }
+                return true;
+            }
+
+            // Number of armed timers
+            size_t size() const {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return index_.size();
+            }
+
+            void stop() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (stop_) {
+                        return ;
+                    }
+                    stop_ = true;
+                }
+
+                cv_.notify_all();
+
+                if (thread_.joinable()) {
+                    if (thread_.get_id() == std::this_thread::get_id()) {
+                        thread_.detach();
+                    } else {
+                        thread_.join();
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto& bucket : slots_) {
+                    bucket.clear();
+                }
+                index_.clear();
+            }
+
+        private:
+            struct entry {
+                timer_id id;
+                size_t rounds;
+                // Delay until the next run, as returned by the last callback
+                std::chrono::milliseconds next_delay;
+                adaptive_callback callback;
+            };
+
+            // Marks a timer whose callback is currently running
+            static constexpr size_t in_flight = static_cast<size_t>(-1);
+
+            // Called with mutex_ held
+            void insert(entry e, std::chrono::milliseconds delay) {
+                // Count ticks from the next tick boundary rather than from now, so a timer never fires
+                // before its delay has elapsed and at most one tick after it
+                auto due = std::chrono::steady_clock::now() + delay;
+                size_t ticks = 1;
+                if (due > next_tick_) {
+                    auto late = due - next_tick_;
+                    ticks += static_cast<size_t>((late + tick_ - std::chrono::steady_clock::duration(1)) / tick_);
+                }
+
+                // cursor_ is the slot that fires on the next tick
+                size_t slot = (cursor_ + ticks - 1) % slots_.size();
+                e.rounds = (ticks - 1) / slots_.size();
+
+                index_[e.id] = slot;
+                slots_[slot].push_back(std::move(e));
+            }
+
+            void run() {
+                std::unique_lock<std::mutex> lock(mutex_);
+
+                while (!stop_) {
+                    cv_.wait_until(lock, next_tick_, [this] { return stop_; });
+                    if (stop_) {
+                        break;
+                    }
+
+                    // Catch up on every tick that elapsed, e.g. after a slow callback
+                    while (!stop_ && std::chrono::steady_clock::now() >= next_tick_) {
+                        std::list<entry> expired;
+                        auto& bucket = slots_[cursor_];
+                        for (auto it = bucket.begin(); it != bucket.end();) {
+                            if (it->rounds == 0) {
+                                index_[it->id] = in_flight;
+                                auto next = std::next(it);
+                                expired.splice(expired.end(), bucket, it);
+                                it = next;
+                            } else {
+                                --it->rounds;
+                                ++it;
+                            }
+                        }
+
+                        cursor_ = (cursor_ + 1) % slots_.size();
+                        next_tick_ += tick_;
+
+                        if (expired.empty()) {
+                            continue;
+                        }
+
+                        // Run callbacks without holding the lock so they can schedule or cancel timers
+                        lock.unlock();
+                        for (auto& e : expired) {
+                            try {
+                                e.next_delay = e.callback();
+                            } catch (...) {
+                                e.next_delay = std::chrono::milliseconds(0);
+                            }
+                        }
+                        lock.lock();
+
+                        for (auto& e : expired) {
+                            auto it = index_.find(e.id);
+                            if (it == index_.end()) {
+                                // Cancelled while running
+                                continue;
+                            }
+
+                            if (e.next_delay.count() > 0 && !stop_) {
+                                auto delay = e.next_delay;
+                                insert(std::move(e), delay);
+                            } else {
+                                index_.erase(it);
+                            }
+                        }
+                    }
+                }
+            }
+
+            const std::chrono::milliseconds tick_;
+            std::vector<std::list<entry>> slots_;
+            std::unordered_map<timer_id, size_t> index_;
+            size_t cursor_ = 0;
+            timer_id next_id_ = 1;
+            std::chrono::steady_clock::time_point next_tick_;
+
+            mutable std::mutex mutex_;
+            std::condition_variable cv_;
+            bool stop_ = false;
+            std::thread thread_;
+    };
+
+} // namespace mcp
+
+#endif // MCP_TIMER_WHEEL_H
@@ -0,0 +1,104 @@
+#ifndef MCP_UUID_H
+#define MCP_UUID_H
+
+#include <string>
+#include <random>
+#include <cstdint>
+#include <cstddef>
+
+namespace mcp {
+
+    // Length of a formatted UUID, 8-4-4-4-12 hexadecimal digits
+    constexpr size_t uuid_length = 36;
+
+    namespace detail {
+        inline uint64_t rotl64(uint64_t x, int b) {
+            return (x << b) | (x >> (64 - b));
+        }
+
+        // SipHash-2-4 of a single 64-bit word
+        inline uint64_t siphash24(uint64_t k0, uint64_t k1, uint64_t m) {
+            uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+            uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+            uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+            uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+
+            auto round = [&]() {
+                v0 += v1; v1 = rotl64(v1, 13); v1 ^= v0; v0 = rotl64(v0, 32);
+                v2 += v3; v3 = rotl64(v3, 16); v3 ^= v2;
+                v0 += v3; v3 = rotl64(v3, 21); v3 ^= v0;
+                v2 += v1; v1 = rotl64(v1, 17); v1 ^= v2; v2 = rotl64(v2, 32);
+            };
+
+            v3 ^= m;
+            round(); round();
+            v0 ^= m;
+
+            // Final block: message length 8, no trailing bytes
+            const uint64_t b = static_cast<uint64_t>(8) << 56;
+            v3 ^= b;
+            round(); round();
+            v0 ^= b;
+
+            v2 ^= 0xff;
+            round(); round(); round(); round();
+
+            return v0 ^ v1 ^ v2 ^ v3;
+        }
+
+        // Per-thread secret key and counter, the key is drawn from std::random_device once per thread
+        struct uuid_state {
+            uint64_t k0;
+            uint64_t k1;
+            uint64_t counter = 0;
+
+            uuid_state() {
+                std::random_device rd;
+                k0 = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+                k1 = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+                counter = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+            }
+        };
+
+        inline void write_hex(char* out, uint64_t value, int digits) {
+            static const char hex[] = "0123456789abcdef";
+            for (int i = digits - 1; i >= 0; --i) {
+                out[i] = hex[value & 0xf];
+                value >>= 4;
+            }
+        }
+    } // namespace detail
+
+    // Write a random version 4 UUID into out (exactly uuid_length chars, not terminated).
+    // Randomness is a keyed hash (SipHash-2-4) of a per-thread counter, so the hot path
+    // never touches std::random_device, a shared lock or the heap.
+    inline void generate_uuid(char* out) {
+        thread_local detail::uuid_state state;
+
+        uint64_t hi = detail::siphash24(state.k0, state.k1, state.counter++);
+        uint64_t lo = detail::siphash24(state.k0, state.k1, state.counter++);
+
+        // Version 4, RFC 4122 variant
+        hi = (hi & 0xffffffffffff0fffULL) | 0x0000000000004000ULL;
+        lo = (lo & 0x3fffffffffffffffULL) | 0x8000000000000000ULL;
+
+        detail::write_hex(out, hi >> 32, 8);
+        out[8] = '-';
+        detail::write_hex(out + 9, (hi >> 16) & 0xffff, 4);
+        out[13] = '-';
+        detail::write_hex(out + 14, hi & 0xffff, 4);
+        out[18] = '-';
+        detail::write_hex(out + 19, lo >> 48, 4);
+        out[23] = '-';
+        detail::write_hex(out + 24, lo & 0xffffffffffffULL, 12);
+    }
+
+    inline std::string generate_uuid() {
+        char buffer[uuid_length];
+        generate_uuid(buffer);
+        return std::string(buffer, uuid_length);
+    }
+
+} // namespace mcp
+
+#endif // MCP_UUID_H
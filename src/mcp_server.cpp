@@ -1,137 +1,133 @@
 #include "mcp_server.h"
+#include "base64.hpp"
+#include "mcp_uuid.h"
 
 namespace mcp {
+#if defined(__linux__)
+    namespace {
+        constexpr bool same_version(const char* a, const char* b) {
+            return *a == *b && (*a == '\0' || same_version(a + 1, b + 1));
+        }
+
+        // handoff_server re-implements a private member of httplib::Server, check it against any other version
+        static_assert(same_version(CPPHTTPLIB_VERSION, "0.19.0"),
+                      "handoff_server::process_and_close_socket mirrors httplib 0.19.0, update it for this httplib version");
+
+        // httplib::Server whose connection threads can give a connection away once its response head is
+        // written, so a long-lived stream does not keep the thread until the client disconnects
+        class handoff_server : public httplib::Server {
+            public:
+                // Called from the content provider of the response being written. If it returns true the
+                // provider must return false: httplib stops writing, and the socket goes to adopt instead
+                // of being closed. False when the connection is not served by a handoff_server.
+                static bool hand_off(std::function<void(socket_t)> adopt) {
+                    if (!current_adopt_) {
+                        return false;
+                    }
+                    *current_adopt_ = std::move(adopt);
+                    return true;
+                }
+
+            private:
+                // Same as httplib 0.19.0's Server::process_and_close_socket, except for the hand-off
+                bool process_and_close_socket(socket_t sock) override {
+                    std::string remote_addr;
+                    int remote_port = 0;
+                    httplib::detail::get_remote_ip_and_port(sock, remote_addr, remote_port);
+
+                    std::string local_addr;
+                    int local_port = 0;
+                    httplib::detail::get_local_ip_and_port(sock, local_addr, local_port);
+
+                    std::function<void(socket_t)> adopt;
+                    auto ret = httplib::detail::process_server_socket(
+                        svr_sock_, sock, keep_alive_max_count_, keep_alive_timeout_sec_,
+                        read_timeout_sec_, read_timeout_usec_, write_timeout_sec_, write_timeout_usec_,
+                        [&](httplib::Stream& strm, bool close_connection, bool& connection_closed) {
+                            current_adopt_ = &adopt;
+                            bool handled = process_request(strm, remote_addr, remote_port, local_addr, local_port,
+                                                           close_connection, connection_closed, nullptr);
+                            current_adopt_ = nullptr;
+                            // A handed off connection ends the keep-alive loop
+                            return handled && !adopt;
+                        });
+
+                    if (adopt) {
+                        adopt(sock);
+                        return true;
+                    }
+
+                    httplib::detail::shutdown_socket(sock);
+                    httplib::detail::close_socket(sock);
+                    return ret;
+                }
+
+                static thread_local std::function<void(socket_t)>* current_adopt_;
+        };
+
+        thread_local std::function<void(socket_t)>* handoff_server::current_adopt_ = nullptr;
+    } // namespace
+#endif
+
     server::server(const std::string& host, int port, const std::string& name, const std::string& version, const std::string& sse_endpoint, const std::string& msg_endpoint)
         : host_(host), port_(port), name_(name), version_(version), sse_endpoint_(sse_endpoint), msg_endpoint_(msg_endpoint) {
+#if defined(__linux__)
+            // Connection threads only write the head of an SSE response, the streams themselves are
+            // served by a few event loops, so httplib keeps its small fixed pool
+            http_server_ = std::make_unique<handoff_server>();
+            sse_reactor_ = std::make_unique<sse_reactor<event_dispatcher>>(std::max<size_t>(1, std::thread::hardware_concurrency() / 8));
+#else
             http_server_ = std::make_unique<httplib::Server>();
+#endif
         }
     
     server::~server() {
         stop();
+#if defined(__linux__)
+        // Close the remaining streams now, their close tasks must run while the members they use still exist
+        sse_reactor_.reset();
+        thread_pool_.wait_idle(shutdown_timeout_);
+#endif
     }
 
     void server::stop() {
-        if (!running_) {
+        // Only the first caller performs the shutdown
+        if (!running_.exchange(false)) {
             return ;
         }
 
         LOG_INFO("Stopping MCP server on ", host_, ":", port_);
-        running_ = false;
-
-        // CLose maintenance thread
-        if (maintenance_thread_ && maintenance_thread_->joinable()) {
-            try {
-                maintenance_thread_->join();
-            } catch (...) {
-                maintenance_thread_->detach();
-            }
-        }
-
-        // Copy all dispatchers and threads to avoid holding the lock for too long
-        std::vector<std::shared_ptr<event_dispatcher>> dispatchers_to_close;
-        std::vector<std::unique_ptr<std::thread>> threads_to_join;
 
+        // New messages are refused from here on, handle_jsonrpc answers them 503. Drain what was
+        // accepted before, queued requests included, so their responses still reach the open SSE streams.
+        // The wait is bounded by the shutdown timeout, not by the size of the backlog.
+        std::chrono::milliseconds shutdown_timeout;
         {
             std::lock_guard<std::mutex> lock(mutex_);
-
-            // Copy all dispatchers
-            dispatchers_to_close.reserve(session_dispatchers_.size());
-            for (const auto& [_, dispatcher] : session_dispatchers_) {
-                dispatchers_to_close.push_back(dispatcher);
-            }
-
-            // Copy all threads
-            threads_to_join.reserve(sse_threads_.size());
-            for (auto& [_, thread] : sse_threads_) {
-                if (thread && thread->joinable()) {
-                    threads_to_join.push_back(std::move(thread));
-                }
-            }
-
-            // Clear the maps
-            session_dispatchers_.clear();
-            sse_threads_.clear();
-            session_initialized_.clear();
+            shutdown_timeout = shutdown_timeout_;
         }
-
-        // CLose all sessions
-        for (const auto& [session_id, _] : session_dispatchers_) {
-            close_session(session_id);
+        if (!thread_pool_.wait_idle(shutdown_timeout)) {
+            LOG_WARNING("In-flight requests did not finish within the shutdown timeout, ", thread_pool_.pending_tasks(), " still queued");
         }
 
-        // Give threads some time to handle close events
-        std::this_thread::sleep_for(std::chrono::milliseconds(300));
-
-        // Wait for threads to finish outside the lock (with timeout limit)
-        const auto timeout_point = std::chrono::steady_clock::now() + std::chrono::seconds(2);
-
-        for (auto& thread : threads_to_join) {
-            if (!thread || !thread->joinable()) {
-                continue;
-            }
+        // Take every session out of the table, one shard at a time
+        std::vector<std::shared_ptr<session>> sessions_to_close = sessions_.take_all();
 
-            if (std::chrono::steady_clock::now() >= timeout_point) {
-                // If timeout reached, detach remaining threads
-                LOG_WARNING("Thread join timeout reached, detaching remaining threads");
-                thread->detach();
-                continue;
-            }
-
-            bool joined = false;
-            try {
-                std::promise<void> thread_done;
-                auto future = thread_done.get_future();
-
-                std::thread join_helper([&thread, &thread_done]() {
-                    try {
-                        thread->join();
-                        thread_done.set_value(); // 把关联的 future 标记为就绪，让 future.wait_for(...) 变为 ready
-                    } catch (...) {
-                        try {
-                            // 若在 join 过程中出错，用 set_exception(...) 把异常关联到 future；
-                            // 等待方随后 future.get() 会抛出该异常
-                            thread_done.set_exception(std::current_exception());
-                        } catch (...) {}
-                    }
-                });
-
-                // Wait for join to complete or timeout
-                if (future.wait_for(std::chrono::illiseconds(100)) == std::future_status::ready) {
-                    future.get();
-                    joined = true;
-                }
-
-                // Process join_helper thread
-                if (join_helper.joinable()) {
-                    if (joined) {
-                        join_helper.join();
-                    } else {
-                        join_heper.detach();
-                    }
-                }
-            } catch (...) {
-                joined = false;
-            }
-
-            // IF join fails, then detach
-            if (!joined) {
-                try {
-                    thread->detach();
-                } catch (...) {
-                    // Ignore exceptions
-                }
-            }
+        // Close all sessions. close() wakes every SSE writer at once, each flushes what is still queued
+        // and ends its stream, so no fixed grace period is needed.
+        for (const auto& s : sessions_to_close) {
+            cancel_session_timers(*s);
+            s->dispatcher->close();
         }
 
+        // Stops listening and joins the connection threads
+        http_server_->stop();
         if (server_thread_ && server_thread_->joinable()) {
-            http_server_->stop();
             try {
                 server_thread_->join();
             } catch (...) {
                 server_thread_->detach();
             }
-        } else {
-            http_server_->stop();
         }
 
         LOG_INFO("MCP server stopped");
@@ -152,149 +148,405 @@ namespace mcp {
         capabilities_ = capabilities;
     }
 
-    void server::register_method(const std::string& method, method_handler) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        method_handlers_[method] = handler;
+    std::shared_ptr<const server::registry> server::registry_snapshot() const {
+        return registry_.load();
+    }
+
+    template<typename F>
+    void server::update_registry(F&& mutate) {
+        registry_.update([&](registry& next) {
+            mutate(next);
+            ++next.version;
+        });
+    }
+
+    void server::register_method(const std::string& method, method_handler handler) {
+        update_registry([&](registry& reg) {
+            reg.method_handlers[method] = std::move(handler);
+
+            // A user handler replaces the built-in listing, so its cache must not be served
+            if (method == "tools/list") {
+                reg.builtin_tools_list = false;
+            } else if (method == "resources/list") {
+                reg.builtin_resources_list = false;
+            }
+        });
     }
 
     void server::register_notification(const std::string& method, notification_handler handler) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        notification_handlers_[method] = handler;
+        update_registry([&](registry& reg) {
+            reg.notification_handlers[method] = std::move(handler);
+        });
     }
 
     void server::register_resource(const std::string& path, std::shared_ptr<resource> resource) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        resources_[path] = resource;
+        update_registry([&](registry& reg) {
+            reg.resources[path] = resource;
 
-        // Register methods for resource access
-        if (method_handlers_.find("resources/read") == method_handlers_.end()) {
-            method_handlers_["resources/read"] = [this](cosnt json& params, cosnt std::string& session_id) -> json {
+            auto& method_handlers = reg.method_handlers;
 
-                // 检查必需参数
-                if (!params.contains("uri")) {
-                    throw mcp_exception(error_code::invalid_params, "Missing 'uri' parameter");
-                }
+            // Register methods for resource access
+            if (method_handlers.find("resources/read") == method_handlers.end()) {
+                method_handlers["resources/read"] = [this](const json& params, const std::string& session_id) -> json {
 
-                // 查找资源
-                std::string uri = params["uri"];
-                auto it = resources_.find(uri);
-                if (it == resources_.end()) {
-                    throw mcp_exception(error_code::invalid_params, "Resource not found: " + uri);
-                }
+                    // 检查必需参数
+                    if (!params.contains("uri")) {
+                        throw mcp_exception(error_code::invalid_params, "Missing 'uri' parameter");
+                    }
+
+                    // 查找资源
+                    std::string uri = params["uri"];
+                    auto reg = registry_snapshot();
+                    auto it = reg->resources.find(uri);
+                    if (it == reg->resources.end()) {
+                        throw mcp_exception(error_code::invalid_params, "Resource not found: " + uri);
+                    }
 
-                // 读取资源内容并返回
-                json contents = json::array();
-                contents.push_back(it->second->read());
+                    // 读取资源内容并返回
+                    json contents = json::array();
+                    contents.push_back(it->second->read());
 
-                return json{
-                    {"contents", contents}
+                    return json{
+                        {"contents", contents}
+                    };
                 };
-            };
-        }
+            }
 
-        if (method_handlers_.find("resources/list") == method_handlers_.end()) {
-            method_handlers_["resources/list"] = [this](const json& params, const std::string& session_id) -> json {
-                json resources = json::array();
+            if (method_handlers.find("resources/list") == method_handlers.end()) {
+                reg.builtin_resources_list = true;
+                method_handlers["resources/list"] = [this](const json& params, const std::string& session_id) -> json {
+                    // 处理分页参数
+                    std::string cursor = params.contains("cursor") && params["cursor"].is_string() ? params["cursor"].get<std::string>() : "";
+                    return build_resources_list(*registry_snapshot(), cursor); // 返回格式：{"resources": [...], "nextCursor": "..."}
+                };
+            }
 
-                // 遍历所有资源，收集元数据
-                for (const auto& [uri, res] : resources_) {
-                    resources.push_back(res->get_metadata());
-                }
+            if (method_handlers.find("resources/subscribe") == method_handlers.end()) {
+                method_handlers["resources/subscribe"] = [this](const json& params, const std::string& session_id) -> json {
+                    if (!params.contains("uri")) {
+                        throw mcp_exception(error_code::invalid_params, "Missing 'uri' parameter");
+                    }
 
-                json result = {
-                    {"resources", resources}
+                    std::string uri = params["uri"];
+                    auto reg = registry_snapshot();
+                    auto it = reg->resources.find(uri);
+
+                    if (it == reg->resources.end()) {
+                        throw mcp_exception(error_code::invalid_params, "Resources not found: " + uri);
+                    }
+                    return json::object();
                 };
+            }
 
-                // 处理分页参数
-                if (params.contains("cursor")) {
-                    result["nextCursor"] = "";
-                }
+            // 实现MCP协议的 resources/templates/list 方法
+            // 目前只是占位符：
+            // 返回空数组 []，表示"暂未实现模板功能"，为将来扩展预留了接口
+            if (method_handlers.find("resources/templates/list") == method_handlers.end()) {
+                method_handlers["resources/templates/list"] = [this](const json& params, const std::string& session_id) -> json {
+                    return json::array();
+                };
+            }
+        });
+    }
 
-                return result; // 返回格式：{"resources": [...], "nextCursor": ""}
-            };
+    // Arguments of a tools/call, some clients send them as a JSON string
+    static json tool_arguments(const json& params) {
+        json tool_args = params.contains("arguments") ? params["arguments"] : json::array();
+
+        if (tool_args.is_string()) {
+            try {
+                tool_args = json::parse(tool_args.get<std::string>());
+            } catch (const json::exception& e) {
+                throw mcp_exception(error_code::invalid_params, "Invalid JSON arguments: " + std::string(e.what()));
+            }
         }
+        return tool_args;
+    }
 
-        if (method_handlers_.find("resources/subscirbe") == method_handlers_.end()) {
-            method_handlers["resources/subscribe"] = [this](const json& params, const std::string& session_id) -> json {
-                if (params.contains("uri")) {
-                    throw mcp_exception(error_code::invalid_params, "Missing 'uri' parameter");
+    // Result of a tool that threw, the call itself succeeds and reports the failure in its content
+    static json tool_error_result(const std::string& message) {
+        return {
+            {"isError", true},
+            {"content", json::array({
+                {
+                    {"type", "text"},
+                    {"text", message}
                 }
+            })}
+        };
+    }
+
+    void server::register_tool(const tool& tool, tool_handler handler) {
+        update_registry([&](registry& reg) {
+            reg.tools[tool.name] = std::make_pair(tool, handler);
+            reg.async_tools.erase(tool.name);
+
+            auto& method_handlers = reg.method_handlers;
+
+            // Register methods for tool listing and calling
+            if (method_handlers.find("tools/list") == method_handlers.end()) {
+                reg.builtin_tools_list = true;
+                method_handlers["tools/list"] = [this](const json& params, const std::string& session_id) -> json {
+                    std::string cursor = params.contains("cursor") && params["cursor"].is_string() ? params["cursor"].get<std::string>() : "";
+                    return build_tools_list(*registry_snapshot(), cursor);
+                };
+            }
+
+            if (method_handlers.find("tools/call") == method_handlers.end()) {
+                method_handlers["tools/call"] = [this](const json& params, const std::string& session_id) -> json {
+                    if (!params.contains("name")) {
+                        throw mcp_exception(error_code::invalid_params, "Missing 'name' parameter");
+                    }
+
+                    std::string tool_name = params["name"];
+                    auto reg = registry_snapshot();
+                    auto it = reg->tools.find(tool_name);
+                    if (it == reg->tools.end()) {
+                        throw mcp_exception(error_code::invalid_params, "Tool not found: " + tool_name);
+                    }
+
+                    json tool_args = tool_arguments(params);
+
+                    json tool_result = {
+                        {"isError", false}
+                    };
+
+                    try {
+                        tool_result["content"] = it->second.second(tool_args, session_id);
+                    } catch (const mcp_exception& e) {
+                        // A cancelled or timed out call fails as a request, it is not a result of the tool
+                        if (e.code() == error_code::request_timeout || e.code() == error_code::request_cancelled) {
+                            throw;
+                        }
+                        tool_result = tool_error_result(e.what());
+                    } catch (const std::exception& e) {
+                        tool_result = tool_error_result(e.what());
+                    }
+                    return tool_result;
+                };
+            }
+        });
+    }
+
+    void server::register_async_tool(const tool& tool, async_tool_handler handler, std::chrono::milliseconds timeout) {
+        // Batches and streamable HTTP answer in the task that runs the call, there only the deadline applies
+        register_tool(tool, [handler, timeout](const json& params, const std::string& session_id) -> json {
+            cancellation_token token = timeout.count() > 0 ? cancellation_token::with_timeout(timeout) : cancellation_token();
+            json content = handler(params, session_id, token);
+            if (token.deadline_exceeded()) {
+                throw mcp_exception(error_code::request_timeout, "Request deadline exceeded");
+            }
+            return content;
+        });
 
-                std::string uri = params["uri"];
-                auto it = resources_.find(uri);
+        update_registry([&](registry& reg) {
+            reg.async_tools[tool.name] = registry::async_tool{handler, timeout};
+        });
+    }
+
+    struct server::async_call {
+        cancellation_token token;
+        json id;
+        std::string key;
+        std::string session_id;
+        std::shared_ptr<event_dispatcher> dispatcher;
+        std::atomic<bool> answered{false};
+        std::atomic<timer_wheel::timer_id> deadline_timer{0};
+
+        // Response of a call that was cancelled or ran past its deadline
+        json cancelled_response() const {
+            if (token.deadline_exceeded()) {
+                return response::create_error(id, error_code::request_timeout, "Request deadline exceeded").to_json();
+            }
+            return response::create_error(id, error_code::request_cancelled, "Request cancelled").to_json();
+        }
+    };
 
-                if (it == resources_.end()) {
-                    throw mcp_exception(error_code::invalid_params, "Resources not found: " + uri);
+    bool server::start_async_tool(const request& req, const std::shared_ptr<session>& target, const std::string& session_id, std::shared_ptr<admission_ticket> ticket) {
+        if (req.method != "tools/call" || !req.params.contains("name") || !req.params["name"].is_string() || !is_session_initialized(session_id)) {
+            return false;
+        }
+
+        auto reg = registry_snapshot();
+        auto it = reg->async_tools.find(req.params["name"].get<std::string>());
+        if (it == reg->async_tools.end()) {
+            return false;
+        }
+
+        json tool_args;
+        try {
+            tool_args = tool_arguments(req.params);
+        } catch (const mcp_exception&) {
+            // The regular tools/call handler reports it
+            return false;
+        }
+
+        const registry::async_tool& entry = it->second;
+        auto call = std::make_shared<async_call>();
+        if (entry.timeout.count() > 0) {
+            call->token = cancellation_token::with_timeout(entry.timeout);
+        }
+        call->id = req.id;
+        call->key = session_id + '\n' + req.id.dump();
+        call->session_id = session_id;
+        call->dispatcher = target->dispatcher;
+        async_calls_.insert(call->key, call);
+
+        // The token and the timer only hold weak references, a finished call is freed with its task
+        std::weak_ptr<async_call> weak_call = call;
+        // Cancellation runs on the timer thread or a connection thread, neither may wait for room in a
+        // slow client's queue, so the answer is sent from the pool
+        call->token.on_cancel([this, weak_call]() {
+            auto cancelled = weak_call.lock();
+            if (!cancelled) {
+                return ;
+            }
+            try {
+                thread_pool_.post([this, cancelled]() {
+                    answer_async_call(*cancelled, cancelled->cancelled_response());
+                }, task_priority::high);
+            } catch (const std::exception&) {
+                // Pool stopped, the sessions are closed and nothing is sent anymore
+                answer_async_call(*cancelled, cancelled->cancelled_response());
+            }
+        });
+
+        if (entry.timeout.count() > 0) {
+            call->deadline_timer.store(timers_.schedule(entry.timeout, [weak_call]() {
+                if (auto expired = weak_call.lock()) {
+                    expired->token.cancel();
                 }
-                return json::object();
-            };
+            }));
+            // Answered before the timer id was stored, nobody else cancels it
+            if (call->answered.load(std::memory_order_acquire)) {
+                timers_.cancel(call->deadline_timer.exchange(0));
+            }
         }
 
-        // 实现MCP协议的 resources/templates/list 方法
-        // 目前只是占位符：
-        // 返回空数组 []，表示"暂未实现模板功能"，为将来扩展预留了接口
-        if (method_handlers_.find("resources/templates/list") == method_handlers_.end()) {
-            method_handlers_["resources/templates/list"] = [this](const json& params, const std::string& session_id) -> json {
-                return json::array();
+        auto task = [this, call, handler = entry.handler, tool_args = std::move(tool_args), ticket]() {
+            // Already answered by a cancellation or the deadline, do not start the handler
+            if (call->token.is_cancelled()) {
+                return ;
+            }
+
+            json tool_result = {
+                {"isError", false}
             };
+            try {
+                tool_result["content"] = handler(tool_args, call->session_id, call->token);
+            } catch (const std::exception& e) {
+                tool_result = tool_error_result(e.what());
+            }
+
+            // A handler that gave up at the deadline may return before the timer fires
+            if (call->token.is_cancelled()) {
+                answer_async_call(*call, call->cancelled_response());
+            } else {
+                answer_async_call(*call, response::create_success(call->id, tool_result).to_json());
+            }
+        };
+
+        try {
+            schedule_message(target, dispatch_class::normal, std::move(task));
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to schedule async tool call: ", e.what());
+            answer_async_call(*call, response::create_error(req.id, error_code::internal_error, e.what()).to_json());
         }
+        return true;
     }
 
-    void server::register_tool(const tool& tool, tool_handler handler) {
-        std::lock_guard<std::mutex> lock(mutex);
-        tools_[tool.name] = std::make_pair(tool, handler);
-
-        // Register methods for tool listing and calling
-        if (method_handlers_.find("tools/list") == method_handlers_.end()) {
-            method_handlers__["tools/list"] = [this](const json& params, const std::string& session_id) -> json {
-                json tools_json = json::array();
-                for (const auto& [name, tool_pair] : tools_) {
-                    tools_json.push_back(tool_pair.first.to_json());
-                }
-                return json{{"tools", tools_json}};
-            };
+    void server::answer_async_call(async_call& call, const json& message) {
+        if (call.answered.exchange(true, std::memory_order_acq_rel)) {
+            return ;
         }
 
-        if (method_handlers_.find("tools/call") == method_handlers_.end()) {
-            method_handlers_["tools/call"] = [this](const json& params, const std::string& session_id) -> json {
-                if (!params.contains("name")) {
-                    throw mcp_exception(error_code::invalid_params, "Missing 'name' parameter");
-                }
+        timers_.cancel(call.deadline_timer.exchange(0));
+        if (async_calls_.find(call.key).get() == &call) {
+            async_calls_.erase(call.key);
+        }
 
-                std::string tool_name = params["name"];
-                auto it = tools_.find(tool_name);
-                if (it == tools_.end()) {
-                    throw mcp_exception(error_code::invalid_params, "Tool not found: " + tool_name);
-                }
+        // The session is gone, nobody reads the answer
+        if (call.dispatcher->is_closed()) {
+            return ;
+        }
 
-                json tool_args = params.contains("arguments") ? params["arguments"] : json::array();
+        if (!call.dispatcher->send_event("event: message\r\ndata: " + message.dump() + "\r\n\r\n")) {
+            LOG_ERROR("Failed to send async tool response via SSE: session_id = ", call.session_id);
+        }
+    }
 
-                if (tool_args.is_string()) {
-                    try {
-                        tool_args = json::parse(tool_args.get<std::string>());
-                    } catch (...) {
-                        throw mcp_exception(error_code::invalid_params, "Invalid JSON arguments: " + std::string(e.what()))
-                    }
-                }
+    void server::cancel_async_call(const std::string& session_id, const json& request_id) {
+        if (auto call = async_calls_.find(session_id + '\n' + request_id.dump())) {
+            call->token.cancel();
+        }
+    }
 
-                json tool_result = {
-                    {"isError", false};
-                };
+    // Cursors are opaque to clients. The payload is the key of the last entry of the previous page
+    // behind a format version, base64 encoded, so pages stay stable when entries are registered
+    // between requests and a cursor of another format is rejected instead of misread.
+    static const std::string cursor_prefix = "v1:";
 
-                try {
-                    tool_result["content"] = it->second.second(tool_args,seesion_id);
-                } catch (const std::exception& e) {
-                    tool_result["isError"] = true;
-                    tool_result["content"] = json:array({
-                        {
-                            {"type", "text"},
-                            {"text",e.what()}
-                        }
-                    });
-                }
-                return tool_result;
-            };
+    static std::string encode_cursor(const std::string& last_key) {
+        return base64::encode(cursor_prefix + last_key);
+    }
+
+    static std::string decode_cursor(const std::string& cursor) {
+        std::string payload;
+        try {
+            payload = base64::decode(cursor);
+        } catch (...) {
+            throw mcp_exception(error_code::invalid_params, "Invalid cursor: " + cursor);
         }
+        if (payload.compare(0, cursor_prefix.size(), cursor_prefix) != 0) {
+            throw mcp_exception(error_code::invalid_params, "Invalid cursor: " + cursor);
+        }
+        return payload.substr(cursor_prefix.size());
+    }
+
+    // Collect one page of an ordered map into result[key], starting after the entry named by cursor
+    template<typename Map, typename F>
+    static json build_page(const Map& entries, const std::string& key, const std::string& cursor, size_t page_size, F&& to_json) {
+        auto it = entries.begin();
+        if (!cursor.empty()) {
+            it = entries.upper_bound(decode_cursor(cursor));
+        }
+
+        json items = json::array();
+        size_t count = 0;
+        for (; it != entries.end() && (page_size == 0 || count < page_size); ++it, ++count) {
+            items.push_back(to_json(it->second));
+        }
+
+        json result = {
+            {key, items}
+        };
+
+        // Only announce a next page when there is one
+        if (it != entries.end() && count > 0) {
+            result["nextCursor"] = encode_cursor(std::prev(it)->first);
+        }
+
+        return result;
+    }
+
+    json server::build_tools_list(const registry& reg, const std::string& cursor) {
+        return build_page(reg.tools, "tools", cursor, reg.list_page_size, [](const std::pair<tool, tool_handler>& tool_pair) {
+            return tool_pair.first.to_json();
+        });
+    }
+
+    json server::build_resources_list(const registry& reg, const std::string& cursor) {
+        // 遍历资源，收集元数据
+        return build_page(reg.resources, "resources", cursor, reg.list_page_size, [](const std::shared_ptr<resource>& res) {
+            return res->get_metadata();
+        });
+    }
+
+    void server::set_list_page_size(size_t page_size) {
+        // Stored in the registry so cached first pages are invalidated with the new version
+        update_registry([&](registry& reg) {
+            reg.list_page_size = page_size;
+        });
     }
 
     void server::register_session_cleanup(const std::string& key, session_cleanup_handler handler) {
@@ -303,10 +555,11 @@ namespace mcp {
     }
 
     std::vector<tool> server::get_tools() const {
-        std::lock_guard<std::mutex> lock(mutex_);
+        auto reg = registry_snapshot();
         std::vector<tool> tools;
+        tools.reserve(reg->tools.size());
 
-        for (const auto& [name, tool_pair] : tools) {
+        for (const auto& [name, tool_pair] : reg->tools) {
             tools.push_back(tool_pair.first);
         }
 
@@ -318,6 +571,23 @@ namespace mcp {
         auth_handler_ = handler;
     }
 
+    void server::set_session_queue_options(size_t max_depth, queue_overflow_policy policy, std::chrono::milliseconds send_timeout) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        session_queue_depth_ = max_depth;
+        session_overflow_policy_ = policy;
+        session_send_timeout_ = send_timeout;
+    }
+
+    void server::set_session_concurrency(size_t max_concurrency) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        session_concurrency_ = max_concurrency;
+    }
+
+    void server::set_shutdown_timeout(std::chrono::milliseconds timeout) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutdown_timeout_ = timeout;
+    }
+
     void server::handle_sse(const httplib::Request& req, httplib::Resposne& res) {
         std::string session_id = generate_session_id();
 
@@ -328,71 +598,116 @@ namespace mcp {
         res.set_header("Access-Control-Allow-Origin", "*");
 
         // Create session-specific event dispatcher
-        auto session_dispatcher = std::make_shared<event_dispatcher>();
+        std::shared_ptr<event_dispatcher> session_dispatcher;
+        std::shared_ptr<task_lane> session_lane;
+        bool session_limited;
+        std::chrono::milliseconds idle_timeout;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            session_dispatcher = std::make_shared<event_dispatcher>(session_queue_depth_, session_overflow_policy_, session_send_timeout_);
+            session_lane = std::make_shared<task_lane>(thread_pool_, session_concurrency_);
+            session_limited = session_concurrency_ > 0;
+            idle_timeout = session_idle_timeout_;
+        }
 
         // Initialize activity time
         session_dispatcher->update_activity();
 
-        // Add session dispatch to mapping table
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            seseison_dispatchers_[session_id] = session_dispatcher;
+        // Add the session to the session table before arming its timers, so a timer callback that
+        // closes the session always finds it
+        auto new_session = std::make_shared<session>(session_dispatcher, session_lane, session_limited);
+        sessions_.insert(session_id, new_session);
+
+        // stop() may have emptied the session table while this session was being set up
+        if (!running_) {
+            close_session(session_id);
         }
 
-        // Create session thread
-        auto thread = std::make_unique<std::thread>([this, res, session_id, session_uri, session_dispatcher]() {
-            try {
-                // Send initial session URI
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
-                std::stringstream ss;
-                ss << "event: endpoint\r\ndata: " << session_uri << "\r\n\r\n";
-                session_dispatcher->send_event(ss.str());
+        // Announce the message endpoint, then send periodic heartbeats to detect connection status.
+        // All sessions share the server's timer wheel instead of owning a sleeping thread.
+        std::string session_uri = msg_endpoint_ + "?session_id=" + session_id;
+        // -1 until the endpoint event has been sent, then the heartbeat counter
+        auto heartbeat_count = std::make_shared<int>(-1);
 
-                // Update activity time (after sending message)
-                session_dispatcher->update_activity();
-
-                // Send periodic heartbeats to detect connection status
-                int heartbeat_count = 0;
-                while (running_ && !session_dispatcher->is_closed()) {
-                    std::this_thread::sleep_for(std::chrono::seconds(5) + std::chrono::milliseconds(rand() % 500)); // NOTE: DO NOT set it the same as the timeout of wait_event
+        // NOTE: DO NOT set the heartbeat interval the same as the timeout of wait_event
+        const auto heartbeat_interval = std::chrono::seconds(5) + std::chrono::milliseconds(rand() % 500);
 
+        new_session->heartbeat_timer = timers_.schedule_every(std::chrono::milliseconds(500), heartbeat_interval,
+            [this, session_id, session_uri, session_dispatcher, heartbeat_count]() -> bool {
+                try {
                     if (session_dispatcher->is_closed() || !running_) {
-                        break;
+                        close_session(session_id);
+                        return false;
                     }
 
-                    std::stringstream heartbeat;
-                    heartbeat << "event: heartbeat\r\ndata: " << heartbeat_count++ << "\r\n\r\n";
+                    std::stringstream ss;
+                    bool is_heartbeat = *heartbeat_count >= 0;
+                    if (is_heartbeat) {
+                        ss << "event: heartbeat\r\ndata: " << (*heartbeat_count)++ << "\r\n\r\n";
+                    } else {
+                        // Send initial session URI
+                        ss << "event: endpoint\r\ndata: " << session_uri << "\r\n\r\n";
+                        *heartbeat_count = 0;
+                    }
 
-                    try {
-                        bool sent = session_dispatcher->send_event(heartbeat.str());
-                        if (!sent) {
-                            LOG_WARNING("发送心跳包失败，客户端可能已经断开连接", session_id);
-                            break;
-                        }
-                    } catch (const std::exception& e) {
-                        LOG_ERROR("Failed to send heartbeat", e.what());
-                        break;
+                    if (!session_dispatcher->send_event(ss.str(), is_heartbeat)) {
+                        LOG_WARNING("发送心跳包失败，客户端可能已经断开连接", session_id);
+                        close_session(session_id);
+                        return false;
                     }
+
+                    // Update activity time (after sending message)
+                    if (!is_heartbeat) {
+                        session_dispatcher->update_activity();
+                    }
+                    return true;
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Failed to send heartbeat", e.what());
+                    close_session(session_id);
+                    return false;
                 }
-            } catch (const std::exception& e) {
-                LOG_ERROR("SSE session thread exception");
-            }
+            });
 
-            close_session(session_id);
-        });
+        // Idle deadline on the same wheel: only sessions whose deadline comes up are looked at,
+        // and a session that saw activity is simply re-armed for the remaining time
+        if (idle_timeout.count() > 0) {
+            new_session->idle_timer = timers_.schedule_adaptive(idle_timeout, [this, session_id, session_dispatcher, idle_timeout]() {
+                return check_session_idle(session_id, session_dispatcher, idle_timeout);
+            });
+        }
 
-        {
-            // 存储thread
-            std::lock_guard<std::mutex> lock(mutex_);
-            sse_threads_[session_id] = std::move(thread);
+        // A close that ran before the timers were stored had nothing to cancel
+        if (sessions_.find(session_id) != new_session) {
+            cancel_session_timers(*new_session);
         }
 
         // Setup chunked content provider 设置分块内容提供者
         res.set_chunked_content_provider("text/event-stream", [this, session_id, session_dispatcher](size_t /* offset */, httplib::DataSink& sink) {
+#if defined(__linux__)
+            // The head is on the wire, hand the socket to the event loops and free the connection thread
+            if (handoff_server::hand_off([this, session_id, session_dispatcher](socket_t sock) {
+                    // Closing runs the cleanup handlers, which must not hold up the event loop. The session's
+                    // async calls are cancelled right away, one of them may be occupying the worker the close waits for.
+                    auto on_close = [this, session_id]() {
+                        cancel_session_async_calls(session_id);
+                        try {
+                            thread_pool_.post([this, session_id]() { close_session(session_id); }, task_priority::high);
+                        } catch (const std::exception&) {
+                            // Pool stopped, stop() has closed the sessions already
+                            close_session(session_id);
+                        }
+                    };
+                    if (!sse_reactor_->add(sock, session_dispatcher, std::move(on_close))) {
+                        httplib::detail::shutdown_socket(sock);
+                        httplib::detail::close_socket(sock);
+                        close_session(session_id);
+                    }
+                })) {
+                return false;
+            }
+#endif
             try {
-                if (session_dispatcher->is_closed()) {
-                    return false;
-                }
+                // A closed dispatcher is handled by wait_event, which first flushes what is still queued
 
                 // 更新活动时间 (received request)
                 session_dispatcher->update_activity();
@@ -430,24 +745,21 @@ namespace mcp {
             return ;
         }
 
+        // Shutting down, do not start new work
+        if (!running_) {
+            res.status = 503;
+            res.set_content("{\"error\":\"Server is shutting down\"}", "application/json");
+            return ;
+        }
+
         // 获取 session ID
         auto it = req.params.find("session_id");
         std::string session_id = it != req.params.end() ? it->second : "";
 
-        // 更新session活动时间
-        if (!session_id.empty()) {
-            std::shared_ptr<event_dispatcher> dispatcher;
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                auto disp_it = session_dispatchers_.find(session_id);
-                if (disp_it != session_dispatchers_.end()) {
-                    dispatcher = disp_it->second;
-                }
-            }
-
-            if (dispatcher) {
-                dispatcher->update_activity();
-            }
+        // 查找 session 并更新活动时间, a single lookup on one shard of the session table
+        std::shared_ptr<session> current_session = session_id.empty() ? nullptr : sessions_.find(session_id);
+        if (current_session) {
+            current_session->dispatcher->update_activity();
         }
 
         // 解析请求
@@ -462,47 +774,106 @@ namespace mcp {
         }
 
         // 检查 session 是否存在
-        std::shard_ptr<event_dispatcher> dispatcher;
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto disp_it = session_dispatchers_.find(session_id);
-            if (disp_it == session_dispatchers_.end()) {
-                // Handle ping request
-                if (req_json["method"] == "ping") {
-                    res.status = 202;
-                    res.set_content("Accepted", "text/plain");
-                    return ;
-                }
-                LOG_ERROR("Session not found: ", session_id);
-                res.status = 404;
-                res.set_content("{\"error\":\"Session not found\"}", "application/json");
+        if (!current_session) {
+            // Handle ping request
+            if (req_json.is_object() && req_json.contains("method") && req_json["method"] == "ping") {
+                res.status = 202;
+                res.set_content("Accepted", "text/plain");
                 return ;
             }
-            dispatcher = disp_it->second;
+            LOG_ERROR("Session not found: ", session_id);
+            res.status = 404;
+            res.set_content("{\"error\":\"Session not found\"}", "application/json");
+            return ;
+        }
+        std::shared_ptr<event_dispatcher> dispatcher = current_session->dispatcher;
+
+        // Streamable HTTP: answer in the body of this POST instead of over the SSE stream
+        bool respond_inline = streamable_http_.load(std::memory_order_relaxed) && accepts_json(req);
+
+        // JSON-RPC batch
+        if (req_json.is_array()) {
+            handle_batch(req_json, current_session, session_id, req.body.size(), respond_inline, res);
+            return ;
         }
 
         // 创建 request object
         request mcp_req;
-        try {
-            mcp_req.jsonrpc = req_json["jsonrpc"].get<std::string>();
-            if (req_json.contains("id") && !req_json["id"].is_null()) {
-                mcp_req.id = req_json["id"];
-            }
-            mcp_req.method = req_json["method"].get<std::string>();
-            if (req_json.contains("params")) {
-                mcp_req.params = req_json["params"];
-            }
-        } catch (const std::exception& e) {
-            LOG_ERROR("Failed to create request object: ", e.what());
+        if (!parse_request(req_json, mcp_req)) {
             res.status = 400;
             res.set_content("{\"error\":\"Invalid request format\"}", "application/json");
             return;
         }
 
+        // Control-plane messages must not wait behind long tool calls
+        dispatch_class route = classify_request(*registry_snapshot(), mcp_req);
+
+        if (respond_inline && !mcp_req.is_notification()) {
+            // Answered in the body of this POST instead of over SSE. Cheap built-ins run right here,
+            // anything else is scheduled like any other request, so session lanes, priorities and the
+            // shutdown drain apply, and this thread only waits for the result up to the deadline.
+            if (route == dispatch_class::inline_fast && !current_session->limited) {
+                res.status = 200;
+                res.set_content(serialize_response(mcp_req, session_id), "application/json");
+                return ;
+            }
+
+            std::shared_ptr<admission_ticket> ticket = admit_request(current_session, req.body.size(), res);
+            if (!ticket) {
+                return ;
+            }
+
+            auto answer = std::make_shared<std::promise<std::string>>();
+            std::future<std::string> result = answer->get_future();
+            json request_id = mcp_req.id;
+            std::string text;
+            try {
+                schedule_message(current_session, route, [this, mcp_req = std::move(mcp_req), session_id, ticket, answer]() {
+                    answer->set_value(serialize_response(mcp_req, session_id));
+                });
+
+                if (result.wait_for(inline_response_timeout_.load(std::memory_order_relaxed)) == std::future_status::ready) {
+                    text = result.get();
+                } else {
+                    text = response::create_error(request_id, error_code::internal_error, "Timeout waiting for response").to_json().dump();
+                }
+            } catch (const std::exception& e) {
+                // Not queued, or dropped unrun by a stopping pool
+                LOG_ERROR("Failed to process inline request: ", e.what());
+                text = response::create_error(request_id, error_code::internal_error, e.what()).to_json().dump();
+            }
+
+            res.status = 200;
+            res.set_content(text, "application/json");
+            return ;
+        }
+
+        // A cancellation has to reach a call that is still running, it never waits behind the session's queue
+        bool cancellation = mcp_req.method == "notifications/cancelled";
+        if (route == dispatch_class::inline_fast && (!current_session->limited || cancellation)) {
+            // Cheap built-ins are answered right here on the connection thread, they never enter the pool.
+            // A limited session queues them like everything else, so they cannot overtake its earlier messages.
+            if (mcp_req.is_notification()) {
+                process_request(mcp_req, session_id);
+            } else {
+                deliver_response(mcp_req, session_id, dispatcher);
+            }
+
+            res.status = 202;
+            res.set_content("Accepted", "text/plain");
+            return ;
+        }
+
+        // Everything below is queued, count it against the admission limits first
+        std::shared_ptr<admission_ticket> ticket = admit_request(current_session, req.body.size(), res);
+        if (!ticket) {
+            return ;
+        }
+
         // If it is a notification (no ID), process it dircetly and return 2022 status code
         if (mcp_req.is_notification()) {
-            // Process it asynchronously in the thread pool
-            thread_pool_.enqueue([this, mcp_req, session_id]() {
+            // Process it asynchronously, ordered with the session's requests when the lane is serial
+            schedule_message(current_session, route, [this, mcp_req = std::move(mcp_req), session_id, ticket]() {
                 process_request(mcp_req, session_id);
             });
 
@@ -512,20 +883,17 @@ namespace mcp {
             return ;
         }
 
+        // A call of an async tool is answered by its result, a cancellation or its deadline, whichever comes first
+        if (start_async_tool(mcp_req, current_session, session_id, ticket)) {
+            res.status = 202;
+            res.set_content("Accepted", "text/plain");
+            return ;
+        }
+
         // For requests with ID, process it asynchronously int the pool and return via SSE
         // 对于带有 ID 的请求，在线程池中异步处理，并通过 SSE 返回结果
-        thread_pool_.enqueue([this, mcp_req, session_id, dispatcher]() {
-            // Process the request
-            json response_json = process_request(mcp_req, session_id);
-
-            // Send response via SSE
-            std::stringstream ss;
-            ss << "event: message\r\ndata: " << response_json.dump() << "\r\n\r\n";
-            bool result = dispatcher->send_event(ss.str());
-
-            if (!result) {
-                LOG_ERROR("Failed to send response via SSE: session_id = ", session_id);
-            }
+        schedule_message(current_session, route, [this, mcp_req = std::move(mcp_req), session_id, dispatcher, ticket]() {
+            deliver_response(mcp_req, session_id, dispatcher);
         });
 
         // Return 202 Accepted
@@ -533,10 +901,329 @@ namespace mcp {
         res.set_content("Accepted", "text/plain");
     }
 
+    bool server::parse_request(const json& message, request& out) {
+        try {
+            out.jsonrpc = message["jsonrpc"].get<std::string>();
+            if (message.contains("id") && !message["id"].is_null()) {
+                out.id = message["id"];
+            }
+            out.method = message["method"].get<std::string>();
+            if (message.contains("params")) {
+                out.params = message["params"];
+            }
+            return true;
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to create request object: ", e.what());
+            return false;
+        }
+    }
+
+    void server::handle_batch(const json& batch, const std::shared_ptr<session>& current_session, const std::string& session_id, size_t body_size, bool respond_inline, httplib::Response& res) {
+        // An empty array is a single invalid request, answered with one response object and not an array
+        if (batch.empty()) {
+            std::string error = response::create_error(nullptr, error_code::invalid_request, "Empty batch").to_json().dump();
+            if (respond_inline) {
+                res.status = 200;
+                res.set_content(error, "application/json");
+                return ;
+            }
+
+            if (!current_session->dispatcher->send_event("event: message\r\ndata: " + error + "\r\n\r\n")) {
+                LOG_ERROR("Failed to send batch response via SSE: session_id = ", session_id);
+            }
+            res.status = 202;
+            res.set_content("Accepted", "text/plain");
+            return ;
+        }
+
+        // Responses are collected in batch order, the last element to finish sends them as one event,
+        // or wakes up this thread when they go back in the POST response.
+        // Once this thread stops waiting, expired keeps late elements from writing their slots.
+        struct batch_state {
+            std::vector<std::string> responses;
+            std::atomic<size_t> remaining{0};
+            std::promise<void> done;
+            std::mutex mutex;
+            bool expired = false;
+        };
+        auto state = std::make_shared<batch_state>();
+
+        // Parse everything first so the number of responses is fixed before any element runs.
+        // Malformed elements are answered right away, notifications get no response slot.
+        constexpr size_t no_response = static_cast<size_t>(-1);
+        std::vector<std::pair<request, size_t>> calls;
+        calls.reserve(batch.size());
+        for (const auto& element : batch) {
+            request call;
+            if (!element.is_object() || !parse_request(element, call)) {
+                state->responses.push_back(response::create_error(nullptr, error_code::invalid_request, "Invalid request").to_json().dump());
+                continue;
+            }
+
+            size_t slot = no_response;
+            if (!call.is_notification()) {
+                slot = state->responses.size();
+                state->responses.emplace_back();
+            }
+            calls.emplace_back(std::move(call), slot);
+        }
+
+        std::shared_ptr<event_dispatcher> dispatcher = current_session->dispatcher;
+
+        auto join_responses = [](const batch_state& finished) {
+            std::string text = "[";
+            for (size_t i = 0; i < finished.responses.size(); ++i) {
+                if (i > 0) {
+                    text += ',';
+                }
+                text += finished.responses[i];
+            }
+            text += "]";
+            return text;
+        };
+
+        auto send_responses = [session_id, dispatcher, respond_inline, join_responses](batch_state& finished) {
+            if (respond_inline) {
+                finished.done.set_value();
+                return ;
+            }
+
+            // A batch of notifications only has nothing to answer
+            if (finished.responses.empty()) {
+                return ;
+            }
+
+            std::string event = "event: message\r\ndata: " + join_responses(finished) + "\r\n\r\n";
+            if (!dispatcher->send_event(event)) {
+                LOG_ERROR("Failed to send batch response via SSE: session_id = ", session_id);
+            }
+        };
+
+        // Answer with whatever has been collected once every element is done.
+        // Inline, a batch of notifications only gets 202 with no body.
+        auto respond = [&res, &state, respond_inline, join_responses]() {
+            if (!respond_inline) {
+                res.status = 202;
+                res.set_content("Accepted", "text/plain");
+            } else if (!state->responses.empty()) {
+                res.status = 200;
+                res.set_content(join_responses(*state), "application/json");
+            } else {
+                res.status = 202;
+            }
+        };
+
+        if (calls.empty()) {
+            if (!respond_inline) {
+                send_responses(*state);
+            }
+            respond();
+            return ;
+        }
+
+        // The whole batch is admitted or refused at once
+        std::shared_ptr<admission_ticket> ticket = admit_request(current_session, body_size, res, calls.size());
+        if (!ticket) {
+            return ;
+        }
+
+        state->remaining.store(calls.size(), std::memory_order_relaxed);
+        std::future<void> done = state->done.get_future();
+        auto reg = registry_snapshot();
+
+        // Record the answer of one element, the last one to finish sends or hands over all of them
+        auto finish = [state, send_responses](size_t slot, std::string answer) {
+            if (slot != no_response) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->expired) {
+                    state->responses[slot] = std::move(answer);
+                }
+            }
+
+            if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                send_responses(*state);
+            }
+        };
+
+        for (const auto& entry : calls) {
+            const request& call = entry.first;
+            const size_t slot = entry.second;
+            dispatch_class route = classify_request(*reg, call);
+
+            auto task = [this, call, slot, session_id, ticket, finish]() {
+                std::string answer;
+                try {
+                    if (slot == no_response) {
+                        process_request(call, session_id);
+                    } else {
+                        answer = serialize_response(call, session_id);
+                    }
+                } catch (const std::exception& e) {
+                    answer = response::create_error(call.id, error_code::internal_error, e.what()).to_json().dump();
+                }
+                finish(slot, std::move(answer));
+            };
+
+            // Elements run in parallel, under the same scheduling rules as single messages.
+            // An element that cannot be queued still counts down, or the batch would never complete.
+            try {
+                schedule_message(current_session, route, std::move(task));
+            } catch (const std::exception& e) {
+                LOG_ERROR("Failed to schedule batch element: ", e.what());
+                finish(slot, response::create_error(call.id, error_code::internal_error, e.what()).to_json().dump());
+            }
+        }
+
+        if (respond_inline) {
+            // Elements still run in parallel on the pool, this thread only waits for the last one, up to the deadline
+            if (done.wait_for(inline_response_timeout_.load(std::memory_order_relaxed)) != std::future_status::ready) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->expired = true;
+                for (const auto& entry : calls) {
+                    if (entry.second != no_response && state->responses[entry.second].empty()) {
+                        state->responses[entry.second] = response::create_error(entry.first.id, error_code::internal_error, "Timeout waiting for response").to_json().dump();
+                    }
+                }
+            }
+        }
+        respond();
+    }
+
+    struct server::admission_ticket {
+        admission_ticket(server& owner, std::shared_ptr<session> target, size_t count, size_t bytes)
+            : owner(owner), target(std::move(target)), count(count), bytes(bytes) {}
+
+        ~admission_ticket() {
+            target->queued.fetch_sub(count, std::memory_order_relaxed);
+            owner.queued_requests_.fetch_sub(count, std::memory_order_relaxed);
+            owner.bytes_in_flight_.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+
+        server& owner;
+        std::shared_ptr<session> target;
+        size_t count;
+        size_t bytes;
+    };
+
+    std::shared_ptr<server::admission_ticket> server::admit_request(const std::shared_ptr<session>& target, size_t bytes, httplib::Response& res, size_t count) {
+        auto reject = [this, &res](int status, const char* message) {
+            rejected_requests_.fetch_add(1, std::memory_order_relaxed);
+            res.status = status;
+            // Only a temporary condition is worth retrying
+            if (status != 413) {
+                res.set_header("Retry-After", "1");
+            }
+            res.set_content(std::string("{\"error\":\"") + message + "\"}", "application/json");
+            return nullptr;
+        };
+
+        // A body that exceeds the byte limit on its own would be refused however long the client waits
+        size_t bytes_limit = max_bytes_in_flight_.load(std::memory_order_relaxed);
+        if (bytes_limit > 0 && bytes > bytes_limit) {
+            return reject(413, "Request larger than the bytes in flight limit");
+        }
+
+        // Reserve first and roll back on failure, so concurrent requests can never overshoot a limit
+        size_t session_limit = max_queued_per_session_.load(std::memory_order_relaxed);
+        if (target->queued.fetch_add(count, std::memory_order_relaxed) + count > session_limit && session_limit > 0) {
+            target->queued.fetch_sub(count, std::memory_order_relaxed);
+            return reject(429, "Too many queued requests for this session");
+        }
+
+        size_t global_limit = max_queued_requests_.load(std::memory_order_relaxed);
+        if (queued_requests_.fetch_add(count, std::memory_order_relaxed) + count > global_limit && global_limit > 0) {
+            queued_requests_.fetch_sub(count, std::memory_order_relaxed);
+            target->queued.fetch_sub(count, std::memory_order_relaxed);
+            return reject(503, "Server overloaded, too many queued requests");
+        }
+
+        if (bytes_in_flight_.fetch_add(bytes, std::memory_order_relaxed) + bytes > bytes_limit && bytes_limit > 0) {
+            bytes_in_flight_.fetch_sub(bytes, std::memory_order_relaxed);
+            queued_requests_.fetch_sub(count, std::memory_order_relaxed);
+            target->queued.fetch_sub(count, std::memory_order_relaxed);
+            return reject(503, "Server overloaded, too many bytes in flight");
+        }
+
+        return std::make_shared<admission_ticket>(*this, target, count, bytes);
+    }
+
+    void server::set_admission_limits(size_t max_queued_requests, size_t max_queued_per_session, size_t max_bytes_in_flight) {
+        max_queued_requests_.store(max_queued_requests, std::memory_order_relaxed);
+        max_queued_per_session_.store(max_queued_per_session, std::memory_order_relaxed);
+        max_bytes_in_flight_.store(max_bytes_in_flight, std::memory_order_relaxed);
+    }
+
+    server::queue_stats server::get_queue_stats() const {
+        queue_stats stats;
+        stats.queued_requests = queued_requests_.load(std::memory_order_relaxed);
+        stats.bytes_in_flight = bytes_in_flight_.load(std::memory_order_relaxed);
+        stats.pool_pending_tasks = thread_pool_.pending_tasks();
+        stats.sessions = sessions_.size();
+        stats.rejected_requests = rejected_requests_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    bool server::accepts_json(const httplib::Request& req) {
+        // Clients opt in by listing application/json in Accept, as in the MCP streamable HTTP transport
+        return req.get_header_value("Accept").find("application/json") != std::string::npos;
+    }
+
+    void server::set_streamable_http(bool enabled) {
+        streamable_http_.store(enabled, std::memory_order_relaxed);
+    }
+
+    void server::set_inline_response_timeout(std::chrono::milliseconds timeout) {
+        inline_response_timeout_.store(timeout, std::memory_order_relaxed);
+    }
+
+    server::dispatch_class server::classify_request(const registry& reg, const request& req) {
+        // Answered from memory without calling user code
+        if (req.method == "ping" || req.method == "initialize" || req.method == "notifications/initialized" || req.method == "notifications/cancelled") {
+            return dispatch_class::inline_fast;
+        }
+
+        if (req.method == "tools/list") {
+            return reg.builtin_tools_list ? dispatch_class::inline_fast : dispatch_class::control;
+        }
+
+        if (req.method == "resources/list") {
+            return reg.builtin_resources_list ? dispatch_class::inline_fast : dispatch_class::control;
+        }
+
+        return dispatch_class::normal;
+    }
+
+    void server::schedule_message(const std::shared_ptr<session>& target, dispatch_class route, std::function<void()> task) {
+        if (route == dispatch_class::normal || target->limited) {
+            // The session lane shares the pool fairly with other sessions and applies the per-session concurrency limit
+            target->lane->post(std::move(task));
+        } else {
+            // Skips the session lane and is picked up by the next free worker before any tool call
+            thread_pool_.post(std::move(task), task_priority::high);
+        }
+    }
+
+    void server::deliver_response(const request& req, const std::string& session_id, const std::shared_ptr<event_dispatcher>& dispatcher) {
+        // Process the request
+        std::string response_text = serialize_response(req, session_id);
+
+        // Send response via SSE
+        std::string event;
+        event.reserve(response_text.size() + 32);
+        event.append("event: message\r\ndata: ").append(response_text).append("\r\n\r\n");
+        bool result = dispatcher->send_event(event);
+
+        if (!result) {
+            LOG_ERROR("Failed to send response via SSE: session_id = ", session_id);
+        }
+    }
+
     json servre::process_request(const request& req, const std::string& session_id) {
         // 检查是否为一个 notification
         if (req.method == "notification/iniitialized") {
             set_session_initialized(session_id, true);
+        } else if (req.method == "notifications/cancelled" && req.params.contains("requestId")) {
+            cancel_async_call(session_id, req.params["requestId"]);
         }
         return json:object();
 
@@ -560,23 +1247,17 @@ namespace mcp {
                 ).to_json();
             }
 
-            // Find registered method handler
-            method_handler handler;
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                auto it = method_handlers_.find(req.method);
-                if (it != method_handlers_.end()) {
-                    handler = it->second;
-                }
-            }
+            // Find registered method handler, lock-free against the current registry snapshot
+            auto reg = registry_snapshot();
+            auto handler_it = reg->method_handlers.find(req.method);
+            const method_handler* handler = handler_it != reg->method_handlers.end() ? &handler_it->second : nullptr;
 
             if (handler) {
-                // Call handler
+                // Call handler inline: process_request already runs on a thread_pool_ worker,
+                // handing the call to another worker and blocking on it would pin two workers
+                // per request and can deadlock the pool once every worker is waiting
                 LOG_INFO("Calling method handler: ", req.method);
-                auto future = thread_pool_.enqueue([handler, params = req.params, session_id]() -> json {
-                    return handler(params, session_id);
-                });
-                json result = future.get();
+                json result = (*handler)(req.params, session_id);
 
                 // Create success response
                 LOG_INFO("Method call successful: ", req.method);
@@ -617,6 +1298,44 @@ namespace mcp {
         }
     }
 
+    std::string server::serialize_response(const request& req, const std::string& session_id) {
+        // The first page of the built-in listings only changes when something is registered,
+        // so it is serialized once per registry version and spliced into the response
+        if (!req.is_notification() && !req.params.contains("cursor") &&
+            (req.method == "tools/list" || req.method == "resources/list") && is_session_initialized(session_id)) {
+            auto reg = registry_snapshot();
+            const serialized_result* cache = nullptr;
+
+            try {
+                if (req.method == "tools/list" && reg->builtin_tools_list) {
+                    std::call_once(reg->tools_list_cache.once, [&] {
+                        reg->tools_list_cache.text = build_tools_list(*reg).dump();
+                    });
+                    cache = &reg->tools_list_cache;
+                } else if (req.method == "resources/list" && reg->builtin_resources_list) {
+                    std::call_once(reg->resources_list_cache.once, [&] {
+                        reg->resources_list_cache.text = build_resources_list(*reg).dump();
+                    });
+                    cache = &reg->resources_list_cache;
+                }
+            } catch (const std::exception& e) {
+                LOG_ERROR("Failed to serialize cached listing: ", e.what());
+                cache = nullptr;
+            }
+
+            if (cache) {
+                // Same layout as response::to_json().dump()
+                std::string id = req.id.dump();
+                std::string text;
+                text.reserve(cache->text.size() + id.size() + 40);
+                text.append("{\"jsonrpc\":\"2.0\",\"id\":").append(id).append(",\"result\":").append(cache->text).append("}");
+                return text;
+            }
+        }
+
+        return process_request(req, session_id).dump();
+    }
+
     json server::handle_initialize(const request& req, const std::string& session_id) {
         const json& params = req.params;
 
@@ -687,16 +1406,12 @@ namespace mcp {
         }
 
         // Get session dispatcher
-        std::shared_ptr<event_dispatcher> dispatcher;
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto it = session_dispatchers_.find(session_id);
-            if (it == session_dispatchers_.end()) {
-                LOG_ERROR("Session not found: ", session_id);
-                return ;
-            }
-            dispatcher = it->second;
+        auto target = sessions_.find(session_id);
+        if (!target) {
+            LOG_ERROR("Session not found: ", session_id);
+            return ;
         }
+        std::shared_ptr<event_dispatcher> dispatcher = target->dispatcher;
 
         // Confirm dispatcher is still valid
         if (!dispatcher || dispatcher->is_closed()) {
@@ -725,9 +1440,8 @@ namespace mcp {
         }
 
         try {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto it = session_intialized_.find(session_id);
-            return (it != session_initialized_.end() && it->second);
+            auto target = sessions_.find(session_id);
+            return target && target->initialized.load(std::memory_order_acquire);
         } catch (const std::exception& e) {
             LOG_ERROR("Exception checking if sesion is intialized: ", e.what());
             return false;
@@ -742,79 +1456,43 @@ namespace mcp {
         }
 
         try {
-            std::lock_guard<std::mutex> lock(mutex_);
             // Check if session still exists
-            auto it = session_dispatchers_.find(session_id);
-            if (it == session_dispatchers_.end()) {
+            auto target = sessions_.find(session_id);
+            if (!target) {
                 LOG_WARNING("Cannot set niitialization state for non-existent session: ", session_id);
                 return ;
             }
-            session_initialized_[session_id] = initialized;
+            target->initialized.store(initialized, std::memory_order_release);
         } catch (const std::exception& e) {
             LOG_ERROR("Exception setting session initialization state: ", e.what());
         }
     }
 
     std::string server::generate_session_id() const {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, 15);
-
-        std::stringstream ss;
-        ss << std::hex;
-        
-        // UUID format 8-4-4-4-12 hexadecimal digits
-        for (int i = 0; i < 8; ++i) {
-            ss << dis(gen);
-        }
-        ss << "-";
-
-        for (int i = 0; i < 4; ++i) {
-            ss << dis(gen);
-        }
-        ss << "-";
-
-        for (int i = 0; i < 4; ++i) {
-            ss << dis(gen);
-        }
-        ss << "-";
-
-        for (int i = 0; i < 4; ++i) {
-            ss << dis(gen);
-        }
-        ss << dis(gen);
-
-        for (int i = 0; i < 12; ++i) {
-            ss << dis(gen);
-        }
-        ss << dis(gen);
-
-        return ss.str();
+        // Version 4 UUID from a per-thread keyed generator, no random_device or stringstream per connect
+        return generate_uuid();
     }
 
-    void server::check_inactive_sessions() {
-        if (!running_) return ;
-
-        const auto now = std::chrono::steady_clock::now();
-        const auto timeout = std::chrono::minutes(60);
-
-        std::vector<std::string> sessions_to_close;
-
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            for (const auto& [session_id, dispatcher] : session_dispatchers_) {
-                if (now - dispatcher->last_activity() > timeout) {
-                    // Exceeded idle time limit
-                    sessions_to_close.push_back(session_id);
-                }
-            }
+    std::chrono::milliseconds server::check_session_idle(const std::string& session_id, const std::shared_ptr<event_dispatcher>& dispatcher, std::chrono::milliseconds timeout) {
+        if (!running_ || dispatcher->is_closed()) {
+            return std::chrono::milliseconds(0);
         }
 
-        // Close inactive sessions
-        for (const auto& session_id : sessions_to_close) {
+        auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - dispatcher->last_activity());
+        if (idle >= timeout) {
+            // Exceeded idle time limit
             LOG_INFO("Closing inactive session: ", session_id);
             close_session(session_id);
+            return std::chrono::milliseconds(0);
         }
+
+        // Activity pushed the deadline back, fire again when it would expire
+        return timeout - idle;
+    }
+
+    void server::set_session_idle_timeout(std::chrono::milliseconds timeout) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        session_idle_timeout_ = timeout;
     }
 
     bool server::set_mount_point(const std::string& mount_point, const std::string& dir, httplib::Headers headers) {
@@ -828,40 +1506,21 @@ namespace mcp {
                 handler(key);
             }
 
-            // Copy resources to be processed
-            std::shared_ptr<event_dispatcher> dispatcher_to_close;
-            std::unique<std::thread> thread_to_release;
-
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-
-                // Get dispatcher pointer
-                auto dispatcher_it = session_dispatcher_.find(session_id);
-                if (dispatcher_it != seesion_dispatchers_.end()) {
-                    dispatcher_to_close = dispatcher_it->second;
-                    session_dispatchers_.erase(thread_it);
-                }
-
-                // Get thread pointer
-                auto thread_it = sse_threads_.find(session_id);
-                if (thread_it != sse_threads_.end()) {
-                    thread_to_release = std::move(thread_it->second);
-                    sse_threads_.erase(thread_it);
-                }
-
-                // Clean up intiialization status
-                session_initialized_.erase(session_id);
+            // Remove the session from the table, only its own shard is locked
+            std::shared_ptr<session> session_to_close = sessions_.erase(session_id);
+            if (!session_to_close) {
+                return ;
             }
 
+            // Stop the session heartbeat and idle timers
+            cancel_session_timers(*session_to_close);
+
             // Close dispatcher outside the lock
-            if (dispatcher_to_close && !dispatcher_to_close->closed()) {
-                dispatcher_to_close->close();
+            if (!session_to_close->dispatcher->is_closed()) {
+                session_to_close->dispatcher->close();
             }
 
-            // Release thread resources
-            if (thread_to_release) {
-                thread_to_release.release();
-            }
+            cancel_session_async_calls(session_id);
         } catch (const std::exception& e) {
             LOG_WARNING("Exception while cleaning up session resources: ", session_id, ", ", e.what());
         } catch (...) {
@@ -869,4 +1528,27 @@ namespace mcp {
         }
     }
 
-} // namespace mcp
\ No newline at end of file
+    void server::cancel_session_async_calls(const std::string& session_id) {
+        std::string call_prefix = session_id + '\n';
+        std::vector<std::shared_ptr<async_call>> calls;
+        async_calls_.for_each([&](const std::string& key, const std::shared_ptr<async_call>& call) {
+            if (key.compare(0, call_prefix.size(), call_prefix) == 0) {
+                calls.push_back(call);
+            }
+        });
+
+        // Their handlers see the token, their answers are dropped with the session
+        for (const auto& call : calls) {
+            async_calls_.erase(call->key);
+            timers_.cancel(call->deadline_timer.exchange(0));
+            call->token.cancel();
+        }
+    }
+
+    void server::cancel_session_timers(session& s) {
+        // Whoever exchanges a timer id out owns cancelling it
+        timers_.cancel(s.heartbeat_timer.exchange(0));
+        timers_.cancel(s.idle_timer.exchange(0));
+    }
+
+} // namespace mcp
@@ -1,6 +1,8 @@
 #include "mcp_sse_client.h"
 #include "base64.hpp"
 
+#include <algorithm>
+
 namespace mcp{
 	sse_client::sse_client(const std::string& host, int port, const std::string& sse_endpoint)
 		:host_(host), port_(port), sse_endpoint_(sse_endpoint) {
@@ -16,26 +18,16 @@ namespace mcp{
 	}
 
 	void sse_client::init_client(const std::string& host, int port) {
-		http_client_ = std::make_unique<httplib::Client>(host.c_str(), port);
 		sse_client_ = std::make_unique<httplib::Client>(host.c_str(), port);
 
-		http_client_->set_connection_timeout(timeout_seconds_, 0);
-		http_client_->set_read_timeout(timeout_seconds_, 0);
-		http_client_->set_write_timeout(timeout_seconds_, 0);
-
 		sse_client_->set_connection_timeout(timeout_seconds_ * 2, 0);
 		sse_client_->set_write_timeout(timeout_seconds_, 0);
 	}
 
 	void sse_clien::init_client(const std::string& base_url) {
 
-		http_client_ = std::make_unique<httplib::Client>(host.c_str(), port);
 		sse_client_ = std::make_unique<httplib::Client>(host.c_str(), port);
 
-		http_client_->set_connection_timeout(timeout_seconds_, 0);
-		http_client_->set_read_timeout(timeout_seconds_, 0);
-		http_client_->set_write_timeout(timeout_seconds_, 0);
-
 		sse_client_->set_connection_timeout(timeout_seconds_ * 2, 0);
 		sse_client_->set_write_timeout(timeout_seconds_, 0);
 	}
@@ -121,12 +113,8 @@ namespace mcp{
 		std::lock_guard<std::mutex> lock(mutex_);
 		default_headers_[key] = value;
 
-		// http_client_：用于发送普通的 JSON-RPC 请求（调用工具等）
 		// sse_client_：用于建立 SSE 连接
-		// 两个客户端都需要相同的头部信息，所以这个函数会同时设置它们。
-		if (http_client_) {
-			http_client->set_default_headers({{key, value}});
-		}
+		// POSTs carry default_headers_ through prepare_post
 		if (sse_client_) {
 			sse_client_->set_default_headers({{key, value}});
 		}
@@ -136,9 +124,10 @@ namespace mcp{
 		std::lock_guard<std::mutex> lock(mutex_);
 		timeout_seconds_ = timeout_seconds;
 
-		if (http_client_) {
-			http_client_->set_connection_timeout(timeout_seconds_, 0);
-			http_client_->set_write_timeout(timeout_seconds_, 0);
+		// Idle POST clients have the old timeouts, new ones are created with these
+		{
+			std::lock_guard<std::mutex> pool_lock(post_clients_mutex_);
+			idle_post_clients_.clear();
 		}
 
 		if (sse_client_) {
@@ -147,6 +136,108 @@ namespace mcp{
 		}
 	}
 
+	void sse_client::set_max_in_flight(size_t max_in_flight) {
+		{
+			std::lock_guard<std::mutex> lock(in_flight_mutex_);
+			max_in_flight_ = max_in_flight;
+		}
+		in_flight_cv_.notify_all();
+	}
+
+	std::unique_ptr<httplib::Client> sse_client::acquire_post_client() {
+		{
+			std::lock_guard<std::mutex> lock(post_clients_mutex_);
+			if (!idle_post_clients_.empty()) {
+				std::unique_ptr<httplib::Client> client = std::move(idle_post_clients_.back());
+				idle_post_clients_.pop_back();
+				return client;
+			}
+		}
+
+		int timeout_seconds;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			timeout_seconds = timeout_seconds_;
+		}
+
+		auto client = base_url_.empty() ? std::make_unique<httplib::Client>(host_.c_str(), port_) : std::make_unique<httplib::Client>(base_url_);
+		client->set_connection_timeout(timeout_seconds, 0);
+		client->set_read_timeout(timeout_seconds, 0);
+		client->set_write_timeout(timeout_seconds, 0);
+		return client;
+	}
+
+	void sse_client::release_post_client(std::unique_ptr<httplib::Client> client) {
+		std::lock_guard<std::mutex> lock(post_clients_mutex_);
+		if (idle_post_clients_.size() < max_idle_post_clients) {
+			idle_post_clients_.push_back(std::move(client));
+		}
+	}
+
+	sse_client::pooled_client::pooled_client(sse_client& owner)
+		: owner_(owner), client_(owner.acquire_post_client()) {}
+
+	sse_client::pooled_client::~pooled_client() {
+		owner_.release_post_client(std::move(client_));
+	}
+
+	sse_client::post_target sse_client::prepare_post() {
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if (msg_endpoint_.empty()) {
+			throw mcp_exception(error_code::internal_error, "Message endpoint not set, SSE connection may not be established");
+		}
+
+		post_target target;
+		target.endpoint = msg_endpoint_;
+		target.timeout_seconds = timeout_seconds_;
+		target.headers.emplace("Content-Type", "application/json");
+		// Lets a streamable HTTP server answer in the POST body, other servers ignore it
+		target.headers.emplace("Accept", "application/json, text/event-stream");
+		for (const auto& [key, value] : default_headers_) {
+			target.headers.emplace(key, value);
+		}
+		return target;
+	}
+
+	size_t sse_client::acquire_in_flight(size_t count, int timeout_seconds) {
+		std::unique_lock<std::mutex> lock(in_flight_mutex_);
+
+		// A request never waits for more slots than the limit allows in total
+		size_t wanted = max_in_flight_ > 0 ? std::min(count, max_in_flight_) : count;
+		bool acquired = in_flight_cv_.wait_for(lock, std::chrono::seconds(timeout_seconds), [&] {
+			return max_in_flight_ == 0 || in_flight_ + wanted <= max_in_flight_;
+		});
+
+		if (!acquired) {
+			throw mcp_exception(error_code::internal_error, timeout_seconds > 0
+				? "Timeout waiting for an in-flight request slot" : "Too many requests in flight");
+		}
+
+		in_flight_ += wanted;
+		return wanted;
+	}
+
+	void sse_client::release_in_flight(size_t count) {
+		if (count == 0) {
+			return ;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(in_flight_mutex_);
+			in_flight_ -= count;
+		}
+		in_flight_cv_.notify_all();
+	}
+
+	sse_client::in_flight_slots::in_flight_slots(sse_client& owner, size_t count, int timeout_seconds)
+		: owner_(owner), count_(owner.acquire_in_flight(count, timeout_seconds)) {
+	}
+
+	sse_client::in_flight_slots::~in_flight_slots() {
+		owner_.release_in_flight(count_);
+	}
+
 	void sse_client::set_capabilities(const json& capabilities) {
 		std::lock_guard<std::mutex> lock(mutex_);
 		capabilities_ = capabilities;
@@ -169,6 +260,99 @@ namespace mcp{
 		send_jsonrpc(req);
 	}
 
+	void sse_client::send_request_async(const std::string& method, const json& params, response_callback callback) {
+		request req = request::create(method, params);
+		json id = req.id;
+
+		int timeout_seconds;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			timeout_seconds = timeout_seconds_;
+		}
+
+		// Fails the request at its deadline, which also frees its slot, unless the response arrives first and cancels it
+		auto deadline = std::make_shared<std::atomic<timer_wheel::timer_id>>(0);
+		deadline->store(timers_.schedule(std::chrono::seconds(timeout_seconds), [this, id]() {
+			complete_pending(id, error_value(error_code::request_timeout, "Timeout waiting for SSE response"));
+		}));
+
+		// Never blocks the caller for a slot
+		try {
+			start_request(req, [this, id, callback, deadline](json value) {
+				timers_.cancel(deadline->exchange(0));
+				callback(make_response(id, value));
+			}, false);
+		} catch (const mcp_exception& e) {
+			timers_.cancel(deadline->exchange(0));
+			callback(response::create_error(id, e.code(), e.what()));
+		} catch (const std::exception& e) {
+			timers_.cancel(deadline->exchange(0));
+			callback(response::create_error(id, error_code::internal_error, e.what()));
+		}
+	}
+
+	std::vector<response> sse_client::send_batch(const std::vector<request>& requests) {
+		if (requests.empty()) {
+			return {};
+		}
+
+		post_target target = prepare_post();
+
+		// One slot per expected response, but never more than the limit so a large batch cannot wait forever
+		size_t expected = 0;
+		for (const auto& req : requests) {
+			if (!req.is_notification()) {
+				++expected;
+			}
+		}
+		in_flight_slots slots(*this, expected, target.timeout_seconds);
+
+		json batch = json::array();
+		batch_waiters waiting;
+		{
+			std::lock_guard<std::mutex> response_lock(response_mutex_);
+			for (const auto& req : requests) {
+				batch.push_back(req.to_json());
+				if (!req.is_notification()) {
+					pending_requests_.insert(req.id, expect_batch_response(req.id, waiting));
+				}
+			}
+		}
+
+		auto forget_pending = [this, &waiting]() {
+			std::lock_guard<std::mutex> response_lock(response_mutex_);
+			for (const auto& [id, future] : waiting) {
+				pending_requests_.erase(id);
+			}
+		};
+
+		// One POST for the whole batch, the responses arrive over SSE or in its body
+		pooled_client http(*this);
+		auto result = http->Post(target.endpoint, target.headers, batch.dump(), "application/json");
+
+		if (!result) {
+			forget_pending();
+			std::string error_msg = httplib::to_string(result.error());
+			LOG_ERROR("JSON-RPC batch request failed: ", error_msg);
+			throw mcp_exception(error_code::internal_error, error_msg);
+		}
+
+		if (result->status / 100 != 2) {
+			forget_pending();
+			throw mcp_exception(error_code::internal_error, "JSON-RPC batch rejected with HTTP status " + std::to_string(result->status) + ": " + result->body);
+		}
+
+		// Answered in the POST body, this completes the pending requests right away
+		dispatch_http_response(*result);
+
+		// All responses share one deadline
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(target.timeout_seconds);
+		return await_batch(waiting, deadline, [this](const json& id) {
+			std::lock_guard<std::mutex> response_lock(response_mutex_);
+			pending_requests_.erase(id);
+		});
+	}
+
 	json sse_client::get_server_capabilities() {
 		return server_capabilities_;
 	}
@@ -181,40 +365,61 @@ namespace mcp{
 	}
 
 	std::vector<tool> sse_client::get_tools() {
-		json response_json = send_request("tools/list", {}).result;
 		std::vector<tool> tools;
+		std::string cursor;
+
+		// Follow nextCursor until the server has returned every page
+		do {
+			json response_json = list_tools(cursor);
+			cursor.clear();
+
+			json tools_json;
+			if (response_json.contains("tools") && response_json["tools"].is_array()) {
+				tools_json = response_json["tools"];
+			} else if (response_json.is_array()) {
+				tools_json = response_json;
+			} else {
+				return tools;
+			}
 
-		json tools_json;
-		if (response_json.contains("tools") && response_json["tools"].is_array()) {
-			tools_json = response_json["tools"];
-		} else if (response_json.is_array()) {
-			tools_json = response_json;
-		} else {
-			return tools;
-		}
+			for (const auto& tool_json : tools_json) {
+				tool t;
+				t.name = tool_json["name"];
+				t.description = tool_json["description"];
 
-		for (const auto& tool_json : tools_json) {
-			tool t;
-			t.name = tool_json["name"];
-			t.description = tool_json["description"];
+				if (tool_json.contains("inputSchema")) {
+					t.parameters_schema = tool_json["inputSchema"];
+				}
 
-			if (tool_json.contains("inputSchema")) {
-				t.parameters_schema = tool_json["inputSchema"];
+				tools.push_back(t);
 			}
 
-			tools.push_back(t);
-		}
+			if (response_json.contains("nextCursor") && response_json["nextCursor"].is_string()) {
+				cursor = response_json["nextCursor"].get<std::string>();
+			}
+		} while (!cursor.empty());
 
 		return tools;
 	}
 
+	json sse_client::list_tools(const std::string& cursor) {
+		json params = json::object();
+		if (!cursor.empty()) {
+			params["cursor"] = cursor;
+		}
+		return send_request("tools/list", params).result;
+	}
+
 	json sse_client::get_capabilities() {
 		return capabilities_;
 	}
 
 	json sse_client::list_resources(const std::string& cursor) {
 		json params = json::object();
-			if (!cursor)
+		if (!cursor.empty()) {
+			params["cursor"] = cursor;
+		}
+		return send_request("resources/list", params).result;
 	}
 
 	json sse_client::read_resource(const std::string& resource_uri) {
@@ -259,31 +464,14 @@ namespace mcp{
 				try {
 					LOG_INFO("SSE thread: Attempting to connect to ", sse_endpoint_);
 
-					std::string buffer;
+					// Parser state is per connection, a reconnect starts from a clean stream
+					sse_parser parser([this](std::string_view event_type, std::string_view data) {
+						handle_sse_event(event_type, data);
+					});
+
 					auto res = sse_client_->Get(sse_endpoint_,
 						[&, this](const char* data, size_t data_length) {
-							buffer.append(data, data_length);
-
-							// Normalize CRLF to LF
-							size_t crlf_pos = buffer.find("\r\n");
-							while (crlf_pos != std::string::npos) {
-								buffer.replace(crlf_pos, 2, "\n");
-								crlf_pos = buffer.find("\r\n", crlf_pos + 1);
-							}
-
-							// Process complete events in buffer
-							size_t start_pos = 0;
-							while ((start_pos = buffer.find("\n\n", start_pos)) != std::string::npos) {
-								size_t end_pos = start_pos + 2;
-								std::string event = buffer.substr(0, start_pos);
-								buffer.erase(0, end_pos);
-								start_pos = 0;
-
-								if (!parse_sse_data(event.data(), event.size())) {
-									LOG_ERROR("SSE thread: Failed to parse event");
-								}
-							}
-
+							parser.feed(data, data_length);
 							return sse_running_.load();
 						});
 					
@@ -327,89 +515,119 @@ namespace mcp{
 		});
 	}
 
-	bool sse_client::parse_sse_data(const char* data, size_t length) {
+	void sse_client::handle_sse_event(std::string_view event_type, std::string_view data) {
 		try {
-			// Split into lines and process event fields
-			std::istringstream stream(std::string(data, length));
-			std::string line;
-			std::string event_type = "message";
-			std::vector<std::string> data_lines;
-
-			while (std::getline(stream, line)) {
-				// Trim trailing CR if present
-				if (!line.empty() && line.back() == '\r') {
-					line.pop_back();
-				}
-
-				if (line.substr(0, 7) == "event: ") {
-					event_type = line.substr(7);
-				} else if (line.substr(0, 6) == "data: ") {
-					data_lines.push_back(line.ubsstr(6));
-				} else if (line.empty()) {
-					break; // End of event
-				}
-			}
-
-			if (data_lines.empty()) {
-				return true;
-			}
-
-			// Join data lines with newlines
-			std::string data_content;
-			for (size_t i = 0; i < data_lines.size(); ++i) {
-				if (i > 0) data_content += '\n';
-				data_content += data_lines[i];
-			}
-
 			if (event_type == "heartbeat") {
-				return true;
+				return ;
 			} else if (event_type == "endpoint") {
 				std::lock_guard<std::mutex> lock(mutex_);
-				msg_endpoint_ = data_content;
+				msg_endpoint_ = std::string(data);
 				endpoint_cv_.notify_all();
-				return true;
 			} else if (event_type == "message") {
 				try {
-					json response = json::parse(data_content);
-
-					if (response.contains("jsonrpc") && response.contains("id") && !response["id"].is_null()) {
-						json id = response["id"];
-
-						std::lock_guard<std::mutex> lock(response_mutex_);
-						auto it = pending_requests_.find(id);
-						if (it != pending_requests_.end()) {
-							if (response.contains("result")) {
-								it->second.set_value(response["result"]);
-							} else if (response.contains("error")) {
-								json error_result = {
-									{"isError", true},
-									{"error", response["error"]}
-								};
-								it->second.set_value(error_result);
-							} else {
-								it->second.set_value(json::object());
-							}
-
-							pending_requests_.erase(it);
-						} else {
-							LOG_WARNING("Received response for unknown request ID: ", id);
+					// Parsed straight out of the parser's buffer
+					json message = json::parse(data.begin(), data.end());
+
+					// A batch response carries one response per batched request
+					if (message.is_array()) {
+						for (const auto& element : message) {
+							dispatch_response(element);
 						}
 					} else {
-						LOG_WARNING("Received unknown event type: ", event_type);
-						return true;
+						dispatch_response(message);
 					}
 				} catch (const json::exception& e) {
-					LOG_ERROR("Failed to parse JSON-RPC response: " e.what());
+					LOG_ERROR("Failed to parse JSON-RPC response: ", e.what());
 				}
-				return true;
 			} else {
-				LOG_WARNING("Received unknown event type: ", event_type);
-				return true;
+				LOG_WARNING("Received unknown event type: ", std::string(event_type));
 			}
 		} catch (const std::exception& e) {
-			LOG_ERROR("Error parsing SSE data: ", e.what());
+			LOG_ERROR("Error handling SSE event: ", e.what());
+		}
+	}
+
+	void sse_client::dispatch_response(const json& response) {
+		if (!response.is_object() || !response.contains("jsonrpc") || !response.contains("id") || response["id"].is_null()) {
+			LOG_WARNING("Received unknown message: ", response.dump());
+			return ;
+		}
+
+		json value;
+		if (response.contains("result")) {
+			value = response["result"];
+		} else if (response.contains("error")) {
+			value = {
+				{"isError", true},
+				{"error", response["error"]}
+			};
+		} else {
+			value = json::object();
+		}
+
+		if (!complete_pending(response["id"], value)) {
+			LOG_WARNING("Received response for unknown request ID: ", response["id"]);
+		}
+	}
+
+	sse_client::completion sse_client::take_pending(const json& id) {
+		completion done;
+		std::lock_guard<std::mutex> lock(response_mutex_);
+		pending_requests_.take(id, done);
+		return done;
+	}
+
+	bool sse_client::complete_pending(const json& id, const json& value) {
+		completion done = take_pending(id);
+		if (!done) {
 			return false;
 		}
+
+		// Outside response_mutex_, an async callback may start another request
+		try {
+			done(value);
+		} catch (const std::exception& e) {
+			LOG_ERROR("Response callback failed: ", e.what());
+		}
+		return true;
+	}
+
+	void sse_client::fail_pending(const std::string& message) {
+		std::vector<completion> pending;
+		{
+			std::lock_guard<std::mutex> lock(response_mutex_);
+			pending = pending_requests_.take_all();
+		}
+
+		json value = error_value(error_code::internal_error, message);
+		for (auto& done : pending) {
+			try {
+				done(value);
+			} catch (const std::exception& e) {
+				LOG_ERROR("Response callback failed: ", e.what());
+			}
+		}
+	}
+
+	void sse_client::dispatch_http_response(const httplib::Response& http_response) {
+		// 202 means the response follows over SSE
+		if (http_response.status != 200 || http_response.body.empty() ||
+			http_response.get_header_value("Content-Type").find("application/json") == std::string::npos) {
+			return ;
+		}
+
+		try {
+			json message = json::parse(http_response.body);
+			if (message.is_array()) {
+				for (const auto& element : message) {
+					dispatch_response(element);
+				}
+			} else {
+				dispatch_response(message);
+			}
+		} catch (const json::exception& e) {
+			LOG_ERROR("Failed to parse JSON-RPC response: ", e.what());
+		}
 	}
 
 	void sse_client::close_sse_connection() {
@@ -422,28 +640,14 @@ namespace mcp{
 
 		sse_running_ = false;
 
-		std::this_thread::sleep_for(std::crono::milliseconds(500));
+		// Interrupt a Get waiting for the next chunk, the SSE thread then sees sse_running_ and exits.
+		// Detaching it instead would destroy sse_client_ under a request still in flight.
+		sse_client_->stop();
 
 		if (sse_thread_ && sse_thread_->joinable()) {
-			auto timeout = std::chrono::seconds(5);
-			auto start = std::chrono::steady_clock::now();
-
 			LOG_INFO("Waiting for SSE thread to end...");
-
-			while (sse_thread_->joinable() && std::chrono::steady_clock::now() - start < timeout) {
-				try {
-					LOG_INFO("SSE thread successfully ended");
-					break;
-				} catch (const std::exception& e) {
-					LOG_ERROR("Error waiting for SSE thread: ", e.what());
-					std::this_thread::sleep_for(std::chrono::milliseconds(100));
-				}
-			}
-
-			if (sse_thread_->joinable()) {
-				LOG_WARNING("SSE thread did not end with timeout, detaching thread");
-				sse_thread_->detach();
-			}
+			sse_thread_->join();
+			LOG_INFO("SSE thread successfully ended");
 		}
 
 		{
@@ -452,120 +656,117 @@ namespace mcp{
 			endpoint_cv_.notify_all();
 		}
 
+		// Responses can no longer arrive, asynchronous callers would otherwise wait forever
+		fail_pending("SSE connection closed");
+
 		LOG_INFO("SSE connection successfully closed (normal exit flow)");
 	}
 
-	json sse_client::send_jsonrpc(const request& req) {
-		std::lock_guard<std::mutex> lock(mutex_);
-
-		if (msg_endpoint_.empty()) {
-			throw mcp_exception(error_code::internal_error, "MEssage endpoint not set, SSE connection may not be established");
-		}
+	void sse_client::start_request(const request& req, completion done, bool wait_for_slot) {
+		post_target target = prepare_post();
 
-		json req_json = req.to_json();
-		std::string req_body = req_json.dump();
-
-		httplib::Headers headers;
-		headers.emplace("Content-Type", "application/json");
-
-		for (const auto& [key, value] : default_headers_) {
-			headers.emplace(key, value);
-		}
-
-		if (req.is_notification()) {
-			auto result = http_client_->Post(msg_endpoint_, headers, req_body, "application/json");
-
-			if (!result) {
-				auto err = result.error();
-				std::string error_msg = httplib::to_string(err);
-				LOG_ERROR("JSON-RPC request failed: ", error_msg);
-				throw mcp_exception(error_code::internal_error, error_msg);
-			}
-
-			return json::object();
-		}
-
-		std::promise<json> response_promise;
-		std::future<json> response_future = response_promise.get_future();
+		// Waits while max_in_flight_ requests are already outstanding, the slot is released once done has run
+		size_t slot = acquire_in_flight(1, wait_for_slot ? target.timeout_seconds : 0);
 
 		{
 			std::lock_guard<std::mutex> response_lock(response_mutex_);
-			pending_requests_[req.id] = std::move(response_promise);
+			pending_requests_.insert(req.id, [this, slot, done = std::move(done)](json value) {
+				release_in_flight(slot);
+				done(std::move(value));
+			});
 		}
 
-		auto result = http_client_->Post(msg_nedpoint_, headers, req_body, "application/json");
+		pooled_client http(*this);
+		auto result = http->Post(target.endpoint, target.headers, req.to_json().dump(), "application/json");
 
 		if (!result) {
-			auto err = result.error();
-			std::string error_msg = httplib::to_string(err);
+			std::string error_msg = httplib::to_string(result.error());
+			LOG_ERROR("JSON-RPC request failed: ", error_msg);
 
-			{
-				std::lock_guard<std::mutex> response_lock(response_mutex_);
-				pending_requests_.erase(req.id);
+			// Unless the response already arrived over SSE, the caller reports the failure
+			if (take_pending(req.id)) {
+				release_in_flight(slot);
+				throw mcp_exception(error_code::internal_error, error_msg);
 			}
-
-			LOG_ERROR("JSON-RPC request failed: ", error_msg);
-			throw mcp_exception(error_code::internal_error, error_msg);
+			return ;
 		}
 
 		if (result->status / 100 != 2) {
+			// A rejected POST (429, 503, 413, ...) fails the request, the sync path throws it as mcp_exception
+			error_code code = error_code::internal_error;
+			std::string message = result->body;
 			try {
 				json res_json = json::parse(result->body);
-
-				{
-					std::lock_guard<std::mutex> response_lock(response_mutex_);
-					pending_requests_.erase(req.id);
+				if (res_json.contains("error") && res_json["error"].is_object()) {
+					const json& err = res_json["error"];
+					if (err.contains("code") && err["code"].is_number_integer()) {
+						code = static_cast<error_code>(err["code"].get<int>());
+					}
+					message = err.value("message", message);
+				} else if (res_json.contains("error") && res_json["error"].is_string()) {
+					message = res_json["error"].get<std::string>();
 				}
+			} catch (const json::exception&) {
+				// Not JSON, report the body as is
+			}
 
-				if (res_json.contains("error")) {
-					int code = res_json["error"]["code"];
-					std::string message = res_json["error"]["message"];
+			complete_pending(req.id, error_value(code, "JSON-RPC request rejected with HTTP status " + std::to_string(result->status) + ": " + message));
+			return ;
+		}
 
-					throw mcp_exception(static_cast<error_code>(code), message);
-				}
+		// Answered in the POST body, this completes the pending request right away
+		dispatch_http_response(*result);
+	}
 
-				if (res_json.contains("result")) {
-					return res_json["result"];
-				} else {
-					return json::object();
-				}
-			} catch (const json::exception& e) {
-				{
-					std::lock_guard<std::mutex> response_lock(response_mutex_);
-					pending_requests_.erase(req.id);
-				}
+	json sse_client::send_jsonrpc(const request& req) {
+		// Only the configuration is read under mutex_, the POST and the wait for the response run without it,
+		// so concurrent callers keep several requests in flight on one session
+		if (req.is_notification()) {
+			post_target target = prepare_post();
+			pooled_client http(*this);
+			auto result = http->Post(target.endpoint, target.headers, req.to_json().dump(), "application/json");
 
-				throw mcp_exception(error_code::parse_error, 
-								"Failed to parse JSON-RPC response: " + std::string(e.what()));
+			if (!result) {
+				auto err = result.error();
+				std::string error_msg = httplib::to_string(err);
+				LOG_ERROR("JSON-RPC request failed: ", error_msg);
+				throw mcp_exception(error_code::internal_error, error_msg);
 			}
-		} else {
-			const auto timeout = std::chrono::seconds(timeout_seconds_);
 
-			auto status = response_future.wait_for(timeout);
+			return json::object();
+		}
 
-			if (status == std::future_status::ready) {
-				json response = response_future.get();
+		auto response_promise = std::make_shared<std::promise<json>>();
+		std::future<json> response_future = response_promise->get_future();
 
-				if (response.contains("isError") && response["isError"].is_boolean() && response["isError"].get<bool>()) {
-					if (response.contains("error") && response["error"].is_object()) {
-						const auto& err_obj = response["error"];
-						int code = err_obj.contains("code") ? err_obj["code"].get<int>() : static_cast<int>(error_code::internal_error);
-						std::string message = err_obj.value("message", "");
-						// Handler error
-						throw mcp_exception(static_cast<error_code>, message);
-					}
-				}
+		start_request(req, [response_promise](json value) {
+			response_promise->set_value(std::move(value));
+		});
 
-				return response;
-			} else {
-				{
-					std::lock_guard<std::mutex> response_lock(response_mutex_);
-					pending_requests_.erase(req.id);
-				}
+		int timeout_seconds;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			timeout_seconds = timeout_seconds_;
+		}
+
+		if (response_future.wait_for(std::chrono::seconds(timeout_seconds)) != std::future_status::ready) {
+			// Fails the request, unless its response won the race
+			complete_pending(req.id, error_value(error_code::internal_error, "Timeout waiting for SSE response"));
+		}
+
+		json response = response_future.get();
 
-				throw mcp_exception(error_code::internal_error, "Timeout waiting for SSE response");
+		if (response.contains("isError") && response["isError"].is_boolean() && response["isError"].get<bool>()) {
+			if (response.contains("error") && response["error"].is_object()) {
+				const auto& err_obj = response["error"];
+				int code = err_obj.contains("code") ? err_obj["code"].get<int>() : static_cast<int>(error_code::internal_error);
+				std::string message = err_obj.value("message", "");
+				// Handler error
+				throw mcp_exception(static_cast<error_code>(code), message);
 			}
 		}
+
+		return response;
 	}
 
 	bool sse_client::is_running() const {
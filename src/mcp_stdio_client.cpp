@@ -4,6 +4,7 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <poll.h>
 
 #include <cstring>
 #include <sstream>
@@ -11,6 +12,9 @@
 #include <chrono>
 
 namespace mcp {
+    // How long a request waits for its response
+    static constexpr auto request_timeout = std::chrono::seconds(60);
+
     stdio_client::stdio_client(const std::string& command, const json& env_vars, const json& capabilities) 
         : command_(command), capabilities_(capabilities), env_vars_(env_vars) {
             LOG_INFO("创建 MCP stdio 客户端: ", command);
@@ -47,8 +51,18 @@ namespace mcp {
         };
 
         // POSIX implementation
+        // 唤醒 pipe: stop_server_process 写入一个字节, 让阻塞在 poll() 中的读线程退出
+        if (pipe(wake_pipe_) == -1) {
+            LOG_ERROR("创建 wake pipe 失败: ", strerror(errno));
+            return false;
+        }
+        // Not inherited by the server process
+        fcntl(wake_pipe_[0], F_SETFD, FD_CLOEXEC);
+        fcntl(wake_pipe_[1], F_SETFD, FD_CLOEXEC);
+
         if (pipe(stdin_pipe_) == -1) {
             LOG_ERROR("创建 stdin pipe 失败: ", strerror(errno));
+            close_wake_pipe();
             return false;
         }
 
@@ -56,6 +70,7 @@ namespace mcp {
             LOG_ERROR("创建 stdout pipe 失败: ", strerror(errno));
             close(stdin_pipe_[0]);
             close(stdin_pipe_[1]);
+            close_wake_pipe();
             return false;
         }
 
@@ -68,6 +83,7 @@ namespace mcp {
             close(stdin_pipe_[1]);
             close(stdout_pipe_[0]);
             close(stdout_pipe_[0]);
+            close_wake_pipe();
             return false;
         }
 
@@ -147,6 +163,7 @@ namespace mcp {
         close(stdin_pipe_[0]);
         close(stdout_pipe_[1]);
 
+        // Non-blocking so the reader can drain the pipe after poll() without blocking in read()
         int flags = fcntl(stdout_pipe_[0], F_GETFL, 0);
         fcntl(stdout_pipe_[0], F_SETFL, fals | O_NONBLOCK);
 
@@ -164,6 +181,7 @@ namespace mcp {
 
             close(stdin_pipe_[1]);
             close(stdout_pipe_[0]);
+            close_wake_pipe();
 
             return false;
         } else if (result == -1) {
@@ -176,11 +194,16 @@ namespace mcp {
 
             close(stdin_pipe_[1]);
             close(stdout_pipe_[0]);
+            close_wake_pipe();
 
             return false;
         }
 
         running_ = true;
+        {
+            std::lock_guard<std::mutex> lock(response_mutex_);
+            reader_stopped_ = false;
+        }
 
         // Start read thread
         read_thread_ = std::make_unique<std::thread>(&stdio_client::read_thread_func, this);
@@ -204,9 +227,11 @@ namespace mcp {
             stdin_pipe_[1] = -1;
         }
 
-        if (stdout_pipe_[0] != -1) {
-            close(stdout_pipe_[0]);
-            stdout_pipe_[0] = -1;
+        // 唤醒读线程, stdout pipe 在线程结束后才关闭, 不会在 poll() 使用中被关闭
+        if (wake_pipe_[1] != -1) {
+            char byte = 0;
+            while (write(wake_pipe_[1], &byte, 1) == -1 && errno == EINTR) {
+            }
         }
 
         // 等待线程结束
@@ -214,6 +239,13 @@ namespace mcp {
             read_thread_->join();
         }
 
+        if (stdout_pipe_[0] != -1) {
+            close(stdout_pipe_[0]);
+            stdout_pipe_[0] = -1;
+        }
+
+        close_wake_pipe();
+
         if (process_id_ > 0) {
             LOG_INFO("发送 SIGTERM to process: ", process_id_);
             kill(pricess_id_, SIGTERM);
@@ -239,132 +271,326 @@ namespace mcp {
         LOG_INFO("Server 进程停止");
     }
 
+    void stdio_client::close_wake_pipe() {
+        for (int& fd : wake_pipe_) {
+            if (fd != -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+
     void stdio_client::read_thread_func() {
         LOG_INFO("Read thread started");
 
-        const int buffer_size = 4096;
-        char buffer[buffer_size];
+        const int buffer_size = 65536;
+        std::vector<char> buffer(buffer_size);
         std::string data_buffer;
 
         // POSIX implementation
-        while (running_) {
-            ssize_t bytes_read = read(stdout_pipe_[0], buffer, buffer_size - 1);
-
-            if (bytes_read > 0) {
-                buffer[bytes_read] = '\0';
-                data_buffer.append(buffer, bytes_read);
-
-                size_t pos = 0;
-                while ((pos = data_buffer.find('\n')) != std::string::npos) {
-                    std::string line = data_buffer.substr(0, pos);
-                    data_buffer.erase(0, pos + 1);
-
-                    if (!line.empty()) {
-                        try {
-                            json message = json::parse(line);
-
-                            if (message.contains("jsonrpc") && message["jsonrpc"] == 2.0) {
-                                if (message.contains("id") && !message["id"].is_null()) {
-                                    // This is aa response
-                                    json id = message["id"];
-
-                                    std::lock_guard<std::mutex> lock(response_mutex);
-                                    auto it = pending_requests_.find(id);
-
-                                    if (it != pending_requests.end()) {
-                                        if (message.contains("result")) {
-                                            it->second.set_value(message["result"]);
-                                        } else if (message.contains("error")) {
-                                            json error_result = {
-                                                {"isError", true},
-                                                {"error", message["error"]}
-                                            };
-                                            it->second.set_value(error_result);
-                                        } else {
-                                            it->second.set_value(json::object());
-                                        }
-
-                                        pending_requests_.erase(it);
-                                    } else {
-                                        LOG_WARNING("Received response for unknown request ID: ", id);
-                                    }
-                                } else if (message.contains("method")) {
-                                    LOG_INFO("Receive request/notification: ", message["method"]);
-                                }
-                            }
-                        } catch (const json::exception& e) {
-                            LOG_INFO("message: ", line);
-                        }
-                    }
+        // Block in poll() until the server writes or the client stops, a response is read as soon as it arrives
+        // and an idle client does not wake up at all
+        pollfd fds[2];
+        fds[0].fd = stdout_pipe_[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = wake_pipe_[0];
+        fds[1].events = POLLIN;
+
+        bool pipe_open = true;
+        while (pipe_open && running_) {
+            fds[0].revents = 0;
+            fds[1].revents = 0;
+
+            if (poll(fds, 2, -1) == -1) {
+                if (errno == EINTR) {
+                    continue;
                 }
-            } else if (bytes_read == 0) {
-                LOG_WARNING("Pipe closed by server");
+                LOG_ERROR("Error polling pipe: ", strerror(errno));
                 break;
-            } else if (bytes_read == -1) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+
+            if (fds[1].revents != 0) {
+                break;
+            }
+
+            if (fds[0].revents == 0) {
+                continue;
+            }
+
+            // Drain everything the server has written so far
+            while (true) {
+                ssize_t bytes_read = read(stdout_pipe_[0], buffer.data(), buffer.size());
+
+                if (bytes_read > 0) {
+                    data_buffer.append(buffer.data(), bytes_read);
+                } else if (bytes_read == 0) {
+                    LOG_WARNING("Pipe closed by server");
+                    pipe_open = false;
+                    break;
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
                 } else {
                     LOG_ERROR("Error reading from pipe: ", strerror(errno));
+                    pipe_open = false;
                     break;
                 }
             }
+
+            // One message per line, the consumed lines are dropped in one go
+            size_t start = 0;
+            size_t pos;
+            while ((pos = data_buffer.find('\n', start)) != std::string::npos) {
+                if (pos > start) {
+                    try {
+                        json message = json::parse(data_buffer.begin() + start, data_buffer.begin() + pos);
+
+                        // A batch response carries one response per batched request
+                        if (message.is_array()) {
+                            for (const auto& element : message) {
+                                dispatch_message(element);
+                            }
+                        } else {
+                            dispatch_message(message);
+                        }
+                    } catch (const json::exception& e) {
+                        LOG_INFO("message: ", data_buffer.substr(start, pos - start));
+                    }
+                }
+                start = pos + 1;
+            }
+            data_buffer.erase(0, start);
+        }
+
+        // Responses can no longer arrive. Refuse new requests first, so none is registered after
+        // the pending ones have been failed and waits forever.
+        {
+            std::lock_guard<std::mutex> lock(response_mutex_);
+            reader_stopped_ = true;
         }
+        fail_pending("Server process exited");
         LOG_INFO("Read thread stopped");
     }
 
-    json stdio_client::send_jsonrpc(const request& req) {
+    void stdio_client::dispatch_message(const json& message) {
+        if (!message.is_object() || !message.contains("jsonrpc") || message["jsonrpc"] != "2.0") {
+            return ;
+        }
+
+        if (message.contains("id") && !message["id"].is_null()) {
+            // This is a response
+            json value;
+            if (message.contains("result")) {
+                value = message["result"];
+            } else if (message.contains("error")) {
+                value = {
+                    {"isError", true},
+                    {"error", message["error"]}
+                };
+            } else {
+                value = json::object();
+            }
+
+            if (!complete_pending(message["id"], value)) {
+                LOG_WARNING("Received response for unknown request ID: ", message["id"]);
+            }
+        } else if (message.contains("method")) {
+            LOG_INFO("Receive request/notification: ", message["method"]);
+        }
+    }
+
+    stdio_client::completion stdio_client::take_pending(const json& id) {
+        completion done;
+        std::lock_guard<std::mutex> lock(response_mutex_);
+        pending_requests_.take(id, done);
+        return done;
+    }
+
+    bool stdio_client::complete_pending(const json& id, const json& value) {
+        completion done = take_pending(id);
+        if (!done) {
+            return false;
+        }
+
+        // Outside response_mutex_, an async callback may start another request
+        try {
+            done(value);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Response callback failed: ", e.what());
+        }
+        return true;
+    }
+
+    void stdio_client::fail_pending(const std::string& message) {
+        std::vector<completion> pending;
+        {
+            std::lock_guard<std::mutex> lock(response_mutex_);
+            pending = pending_requests_.take_all();
+        }
+
+        json value = error_value(error_code::internal_error, message);
+        for (auto& done : pending) {
+            try {
+                done(value);
+            } catch (const std::exception& e) {
+                LOG_ERROR("Response callback failed: ", e.what());
+            }
+        }
+    }
+
+    void stdio_client::send_request_async(const std::string& method, const json& params, response_callback callback) {
+        request req = request::create(method, params);
+        json id = req.id;
+
+        // Fails the request at its deadline, unless the response arrives first and cancels it
+        auto deadline = std::make_shared<std::atomic<timer_wheel::timer_id>>(0);
+        deadline->store(timers_.schedule(request_timeout, [this, id]() {
+            complete_pending(id, error_value(error_code::request_timeout, "Timeout waiting for response"));
+        }));
+
+        try {
+            start_request(req, [this, id, callback, deadline](json value) {
+                timers_.cancel(deadline->exchange(0));
+                callback(make_response(id, value));
+            });
+        } catch (const mcp_exception& e) {
+            timers_.cancel(deadline->exchange(0));
+            callback(response::create_error(id, e.code(), e.what()));
+        } catch (const std::exception& e) {
+            timers_.cancel(deadline->exchange(0));
+            callback(response::create_error(id, error_code::internal_error, e.what()));
+        }
+    }
+
+    std::vector<response> stdio_client::send_batch(const std::vector<request>& requests) {
+        if (requests.empty()) {
+            return {};
+        }
+
         if (!running_) {
             throw mcp_exception(error_code::internal_error, "Server process not running");
         }
-        json req_json = req.to_json();
-        std::string req_str = req_json.dump() + "\n";
 
-        // POSIX implementation
-        // 使用 write() 系统调用向管道写入数据
-        ssize_t bytes_written = write(stdin_pipe_[1], req_str.c_str(), req_str.size());
+        json batch = json::array();
+        batch_waiters waiting;
+        {
+            std::lock_guard<std::mutex> lock(response_mutex_);
+            if (reader_stopped_) {
+                throw mcp_exception(error_code::internal_error, "Server process not running");
+            }
+            for (const auto& req : requests) {
+                batch.push_back(req.to_json());
+                if (!req.is_notification()) {
+                    pending_requests_.insert(req.id, expect_batch_response(req.id, waiting));
+                }
+            }
+        }
+
+        // The whole batch is one line on the pipe
+        if (!write_line(batch.dump() + "\n")) {
+            LOG_ERROR("Failed to write complete batch: ", strerror(errno));
+            std::lock_guard<std::mutex> lock(response_mutex_);
+            for (const auto& [id, future] : waiting) {
+                pending_requests_.erase(id);
+            }
+            throw mcp_exception(error_code::internal_error, "Failed to write to pipe");
+        }
+
+        // All responses share one deadline
+        const auto deadline = std::chrono::steady_clock::now() + request_timeout;
+        return await_batch(waiting, deadline, [this](const json& id) {
+            std::lock_guard<std::mutex> lock(response_mutex_);
+            pending_requests_.erase(id);
+        });
+    }
+
+    json stdio_client::list_tools(const std::string& cursor) {
+        json params = json::object();
+        if (!cursor.empty()) {
+            params["cursor"] = cursor;
+        }
+        return send_request("tools/list", params).result;
+    }
 
-        // 检查实际写入的字节数是否等于预期写入的字节数
-        // 如果不相等，说明写入操作没有完全成功
-        if (bytes_written != static_cast<ssize_t>(req_str.size())) {
+    bool stdio_client::write_line(const std::string& line) {
+        // One message per line: a line longer than PIPE_BUF is not written atomically, so concurrent
+        // senders take turns, and a short write continues where it stopped
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        size_t written = 0;
+        while (written < line.size()) {
+            ssize_t n = write(stdin_pipe_[1], line.data() + written, line.size() - written);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            written += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void stdio_client::start_request(const request& req, completion done) {
+        if (!running_) {
+            throw mcp_exception(error_code::internal_error, "Server process not running");
+        }
+
+        // Registered before the write, the response may arrive before write() returns
+        {
+            std::lock_guard<std::mutex> lock(response_mutex_);
+            if (reader_stopped_) {
+                throw mcp_exception(error_code::internal_error, "Server process not running");
+            }
+            pending_requests_.insert(req.id, std::move(done));
+        }
+
+        if (!write_line(req.to_json().dump() + "\n")) {
             LOG_ERROR("Failed to write complete request: ", strerror(errno));
-            throw mcp_exception(error_code::internal, "Failed to write to pipe");
+            take_pending(req.id);
+            throw mcp_exception(error_code::internal_error, "Failed to write to pipe");
+        }
+    }
+
+    json stdio_client::send_jsonrpc(const request& req) {
+        if (!running_) {
+            throw mcp_exception(error_code::internal_error, "Server process not running");
         }
 
         // If this is a notification, no need to wait for a response
         if (req.is_notification()) {
-            return json:object();
+            if (!write_line(req.to_json().dump() + "\n")) {
+                LOG_ERROR("Failed to write complete request: ", strerror(errno));
+                throw mcp_exception(error_code::internal_error, "Failed to write to pipe");
+            }
+            return json::object();
         }
 
         // 创建 promise 和 future
-        std::promise<json> response_promise;
-        std::future<json> response_future = response_promise.get_future();
+        auto response_promise = std::make_shared<std::promise<json>>();
+        std::future<json> response_future = response_promise->get_future();
 
-        {
-            std::lock_guard<std::mutex> lock(response_mutex_);
-            pending_requests[req.id] = std::move(response_promise);
-        }
+        start_request(req, [response_promise](json value) {
+            response_promise->set_value(std::move(value));
+        });
 
         // 等待回复，设置超时时间
-        const auto timeout = std::chrono::seconds(60);
-        auto status = response_future.wait_for(timeout);
+        if (response_future.wait_for(request_timeout) != std::future_status::ready) {
+            // Fails the request, unless its response won the race
+            complete_pending(req.id, error_value(error_code::internal_error, "Timeout waiting for response"));
+        }
 
-        if (status == std::future_status::ready) {
-            json resposne = response_future.get();
+        json response = response_future.get();
 
-            if (response.contains("isError") && response["isError"].is_boolean() && response["isError"].get<bool>()) {
-                if (response.contains("error") && response["error"].is_object()) {
-                    const auto& err_pbj = response["error"];
-                    int code = err_obj.contains("code") ? err_obj["code"].get<int>() : static_cast<int>(error_code::internal_error);
-                    throw mcp_exception(static_cast<error_code>(code), message);
-                }
+        if (response.contains("isError") && response["isError"].is_boolean() && response["isError"].get<bool>()) {
+            if (response.contains("error") && response["error"].is_object()) {
+                const auto& err_obj = response["error"];
+                int code = err_obj.contains("code") ? err_obj["code"].get<int>() : static_cast<int>(error_code::internal_error);
+                std::string message = err_obj.value("message", "");
+                throw mcp_exception(static_cast<error_code>(code), message);
             }
-
-            return response;
-        } else {
-            std::lock_guard<std::mutex> lock(response_mutex_);
-            pending_requests_.erase(req.id);
-            
-            throw mcp_exception(error_code::internal_error, "Timeout waiting for response");
         }
+
+        return response;
     }
 } // namespace mcp
\ No newline at end of file
@@ -12,6 +12,12 @@
 #include "mcp_server.h"
 #include "mcp_tool.h"
 #include "mcp_sse_client.h"
+#include "mcp_uuid.h"
+#include "mcp_pending_table.h"
+#include "mcp_copy_on_write.h"
+
+#include <set>
+#include <deque>
 
 using namespace mcp;
 using json = nlohmann::ordered_json;
@@ -405,6 +411,36 @@ TEST_F(PingTest, PingRequest) {
     EXPECT_TRUE(ping_result);
 }
 
+// Test asynchronous requests, many outstanding from one thread
+TEST_F(PingTest, AsyncPing) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // The shared client may already be connected by an earlier test
+    if (!client_->is_running()) {
+        ASSERT_TRUE(client_->initialize("TestClient", "1.0.0"));
+    }
+
+    std::vector<std::future<json>> futures;
+    for (int i = 0; i < 16; ++i) {
+        futures.push_back(client_->send_request_async("ping"));
+    }
+    for (auto& future : futures) {
+        ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        EXPECT_TRUE(future.get().empty());
+    }
+
+    std::promise<response> callback_promise;
+    client_->send_request_async("ping", json::object(), [&](const response& res) {
+        callback_promise.set_value(res);
+    });
+    auto callback_future = callback_promise.get_future();
+    ASSERT_EQ(callback_future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_FALSE(callback_future.get().is_error());
+
+    // Errors surface through the future
+    auto missing = client_->send_request_async("no/such/method");
+    EXPECT_THROW(missing.get(), mcp_exception);
+}
+
 TEST_F(PingTest, DirectPing) {
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
     try {
@@ -658,6 +694,1384 @@ TEST_F(ToolsTest, CallTool) {
     EXPECT_EQ(tool_result["content"][0]["text"], "Current weather in New York:\nTemperature: 72°F\nConditions: Partly cloudy");
 }
 
+// Pagination test environment
+class PaginationEnvironment : public ::testing::Environment {
+public:
+    void SetUp() override {
+        server_ = std::make_unique<server>("localhost", 8084);
+        server_->set_server_info("TestServer", "1.0.0");
+
+        // 25 tools served 10 per page
+        for (int i = 0; i < 25; ++i) {
+            std::string name = (i < 10 ? "tool_0" : "tool_") + std::to_string(i);
+            server_->register_tool(tool{name, "Test tool " + std::to_string(i), {{"type", "object"}}},
+                [](const json& /* params */, const std::string& /* session_id */) -> json {
+                    return json::array();
+                });
+        }
+        server_->set_list_page_size(10);
+
+        server_->start(false);
+
+        client_ = std::make_unique<sse_client>("localhost", 8084);
+        client_->initialize("TestClient", "1.0.0");
+    }
+
+    void TearDown() override {
+        client_.reset();
+        server_->stop();
+        server_.reset();
+    }
+
+    static std::unique_ptr<sse_client>& GetClient() {
+        return client_;
+    }
+
+private:
+    static std::unique_ptr<server> server_;
+    static std::unique_ptr<sse_client> client_;
+};
+
+std::unique_ptr<server> PaginationEnvironment::server_;
+std::unique_ptr<sse_client> PaginationEnvironment::client_;
+
+class PaginationTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        client_ = PaginationEnvironment::GetClient().get();
+    }
+
+    sse_client* client_;
+};
+
+// Test that the first page is capped at the page size and announces the next one
+TEST_F(PaginationTest, FirstPage) {
+    json page = client_->list_tools();
+    ASSERT_EQ(page["tools"].size(), 10u);
+    EXPECT_EQ(page["tools"][0]["name"], "tool_00");
+    EXPECT_EQ(page["tools"][9]["name"], "tool_09");
+    ASSERT_TRUE(page.contains("nextCursor"));
+    EXPECT_TRUE(page["nextCursor"].is_string());
+}
+
+// Test following nextCursor until the last page
+TEST_F(PaginationTest, FollowCursorToTheEnd) {
+    std::vector<std::string> names;
+    std::vector<size_t> page_sizes;
+    std::string cursor;
+    do {
+        json page = client_->list_tools(cursor);
+        page_sizes.push_back(page["tools"].size());
+        for (const auto& item : page["tools"]) {
+            names.push_back(item["name"].get<std::string>());
+        }
+        cursor = page.contains("nextCursor") ? page["nextCursor"].get<std::string>() : "";
+    } while (!cursor.empty() && page_sizes.size() < 10);
+
+    EXPECT_EQ(page_sizes, (std::vector<size_t>{10, 10, 5}));
+    ASSERT_EQ(names.size(), 25u);
+    EXPECT_EQ(names.front(), "tool_00");
+    EXPECT_EQ(names.back(), "tool_24");
+}
+
+// Test that a cursor the server did not hand out is rejected with invalid_params
+TEST_F(PaginationTest, InvalidCursor) {
+    for (const std::string cursor : {"not base64 !", "dG9vbF8wOQ=="}) {
+        try {
+            client_->list_tools(cursor);
+            ADD_FAILURE() << "cursor accepted: " << cursor;
+        } catch (const mcp_exception& e) {
+            EXPECT_EQ(e.code(), error_code::invalid_params);
+        }
+    }
+}
+
+// Test that iterate_tools visits every tool exactly once across pages
+TEST_F(PaginationTest, IterateToolsVisitsEveryItemOnce) {
+    std::map<std::string, int> seen;
+    auto tools = client_->iterate_tools();
+    json item;
+    while (tools.next(item)) {
+        seen[item["name"].get<std::string>()]++;
+    }
+
+    ASSERT_EQ(seen.size(), 25u);
+    for (const auto& [name, count] : seen) {
+        EXPECT_EQ(count, 1) << name;
+    }
+}
+
+// One SSE session driven with raw HTTP, for tests that look at status codes and headers
+class raw_session {
+public:
+    explicit raw_session(int port) : sse_("localhost", port), http_("localhost", port) {
+        reader_ = std::thread([this]() {
+            sse_parser parser([this](std::string_view event_type, std::string_view data) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (event_type == "endpoint") {
+                    endpoint_ = std::string(data);
+                } else if (event_type == "message") {
+                    messages_.push_back(json::parse(data));
+                }
+                cv_.notify_all();
+            });
+            sse_.Get("/sse", [&parser](const char* data, size_t length) {
+                parser.feed(data, length);
+                return true;
+            });
+        });
+    }
+
+    ~raw_session() {
+        sse_.stop();
+        reader_.join();
+    }
+
+    // Open the session with initialize and notifications/initialized
+    bool initialize() {
+        json params = {{"protocolVersion", MCP_VERSION}, {"clientInfo", {{"name", "RawClient"}, {"version", "1.0.0"}}}, {"capabilities", json::object()}};
+        auto res = post(request::create("initialize", params).to_json().dump());
+        json message;
+        if (!res || res->status != 202 || !next_message(message)) {
+            return false;
+        }
+        res = post(request::create_notification("initialized").to_json().dump());
+        return res && res->status == 202;
+    }
+
+    httplib::Result post(const std::string& body, const httplib::Headers& headers = {}) {
+        std::string target;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait_for(lock, std::chrono::seconds(5), [this]() { return !endpoint_.empty(); });
+            target = endpoint_;
+        }
+        return http_.Post(target, headers, body, "application/json");
+    }
+
+    // Next message event, false if none arrives within the timeout
+    bool next_message(json& message, std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!cv_.wait_for(lock, timeout, [this]() { return !messages_.empty(); })) {
+            return false;
+        }
+        message = std::move(messages_.front());
+        messages_.pop_front();
+        return true;
+    }
+
+private:
+    httplib::Client sse_;
+    httplib::Client http_;
+    std::thread reader_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::string endpoint_;
+    std::deque<json> messages_;
+};
+
+// Admission control test environment, test/hold keeps requests queued until the gate opens
+class AdmissionEnvironment : public ::testing::Environment {
+public:
+    void SetUp() override {
+        server_ = std::make_unique<server>("localhost", 8085);
+        server_->set_server_info("TestServer", "1.0.0");
+        server_->register_method("test/hold", [](const json& /* params */, const std::string& /* session_id */) -> json {
+            std::unique_lock<std::mutex> lock(gate_mutex_);
+            gate_cv_.wait(lock, []() { return gate_open_; });
+            return json::object();
+        });
+        server_->start(false);
+    }
+
+    void TearDown() override {
+        open_gate();
+        server_->stop();
+        server_.reset();
+    }
+
+    static server& GetServer() {
+        return *server_;
+    }
+
+    static void close_gate() {
+        std::lock_guard<std::mutex> lock(gate_mutex_);
+        gate_open_ = false;
+    }
+
+    static void open_gate() {
+        std::lock_guard<std::mutex> lock(gate_mutex_);
+        gate_open_ = true;
+        gate_cv_.notify_all();
+    }
+
+private:
+    static std::unique_ptr<server> server_;
+    static std::mutex gate_mutex_;
+    static std::condition_variable gate_cv_;
+    static bool gate_open_;
+};
+
+std::unique_ptr<server> AdmissionEnvironment::server_;
+std::mutex AdmissionEnvironment::gate_mutex_;
+std::condition_variable AdmissionEnvironment::gate_cv_;
+bool AdmissionEnvironment::gate_open_ = true;
+
+class AdmissionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        server_ = &AdmissionEnvironment::GetServer();
+        AdmissionEnvironment::close_gate();
+    }
+
+    void TearDown() override {
+        AdmissionEnvironment::open_gate();
+        server_->set_admission_limits(4096, 256, 64 * 1024 * 1024);
+    }
+
+    static std::string hold_request(const std::string& padding = "") {
+        return request::create("test/hold", {{"padding", padding}}).to_json().dump();
+    }
+
+    // Release the held requests, wait for their responses and for the counters to drain
+    void release(raw_session& session, size_t responses) {
+        AdmissionEnvironment::open_gate();
+        json message;
+        for (size_t i = 0; i < responses; ++i) {
+            ASSERT_TRUE(session.next_message(message));
+            EXPECT_TRUE(message.contains("result"));
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        auto stats = server_->get_queue_stats();
+        while ((stats.queued_requests != 0 || stats.bytes_in_flight != 0) && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            stats = server_->get_queue_stats();
+        }
+        EXPECT_EQ(stats.queued_requests, 0u);
+        EXPECT_EQ(stats.bytes_in_flight, 0u);
+    }
+
+    server* server_;
+};
+
+// Test that a session over its own limit gets 429 with Retry-After
+TEST_F(AdmissionTest, PerSessionLimit) {
+    server_->set_admission_limits(100, 2, 1024 * 1024);
+    raw_session session(8085);
+    ASSERT_TRUE(session.initialize());
+
+    for (int i = 0; i < 2; ++i) {
+        auto res = session.post(hold_request());
+        ASSERT_TRUE(res);
+        EXPECT_EQ(res->status, 202);
+    }
+
+    auto rejected = session.post(hold_request());
+    ASSERT_TRUE(rejected);
+    EXPECT_EQ(rejected->status, 429);
+    EXPECT_EQ(rejected->get_header_value("Retry-After"), "1");
+    EXPECT_EQ(server_->get_queue_stats().queued_requests, 2u);
+
+    release(session, 2);
+}
+
+// Test that a server over its global limit gets 503 with Retry-After, whichever session asks
+TEST_F(AdmissionTest, GlobalLimit) {
+    server_->set_admission_limits(2, 100, 1024 * 1024);
+    raw_session first(8085);
+    raw_session second(8085);
+    ASSERT_TRUE(first.initialize());
+    ASSERT_TRUE(second.initialize());
+
+    for (int i = 0; i < 2; ++i) {
+        auto res = first.post(hold_request());
+        ASSERT_TRUE(res);
+        EXPECT_EQ(res->status, 202);
+    }
+
+    auto rejected = second.post(hold_request());
+    ASSERT_TRUE(rejected);
+    EXPECT_EQ(rejected->status, 503);
+    EXPECT_EQ(rejected->get_header_value("Retry-After"), "1");
+
+    release(first, 2);
+}
+
+// Test the byte limit, 503 while other bodies are in flight and 413 for a body that can never fit
+TEST_F(AdmissionTest, ByteLimit) {
+    size_t body_size = hold_request().size();
+    server_->set_admission_limits(100, 100, body_size + body_size / 2);
+    raw_session session(8085);
+    ASSERT_TRUE(session.initialize());
+
+    auto accepted = session.post(hold_request());
+    ASSERT_TRUE(accepted);
+    EXPECT_EQ(accepted->status, 202);
+    EXPECT_EQ(server_->get_queue_stats().bytes_in_flight, body_size);
+
+    auto rejected = session.post(hold_request());
+    ASSERT_TRUE(rejected);
+    EXPECT_EQ(rejected->status, 503);
+    EXPECT_EQ(rejected->get_header_value("Retry-After"), "1");
+
+    auto too_large = session.post(hold_request(std::string(body_size * 2, 'x')));
+    ASSERT_TRUE(too_large);
+    EXPECT_EQ(too_large->status, 413);
+    EXPECT_FALSE(too_large->has_header("Retry-After"));
+
+    release(session, 1);
+}
+
+// Test that a request the server rejects with an HTTP error fails through the client instead of returning a result
+TEST_F(AdmissionTest, ClientSeesRejection) {
+    server_->set_admission_limits(100, 1, 1024 * 1024);
+    sse_client client("localhost", 8085);
+    ASSERT_TRUE(client.initialize("AdmissionClient", "1.0.0"));
+
+    std::promise<response> held;
+    client.send_request_async("test/hold", json::object(), [&held](const response& res) {
+        held.set_value(res);
+    });
+
+    try {
+        client.send_request("test/hold");
+        FAIL() << "A request over the session limit returned a result";
+    } catch (const mcp_exception& e) {
+        EXPECT_NE(std::string(e.what()).find("429"), std::string::npos) << e.what();
+    }
+
+    AdmissionEnvironment::open_gate();
+    auto future = held.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_FALSE(future.get().is_error());
+}
+
+// Test that an asynchronous request fails fast without a free slot and fails at its deadline without a response
+TEST(AsyncRequestTest, SlotAndDeadline) {
+    AdmissionEnvironment::close_gate();
+    {
+        sse_client client("localhost", 8085);
+        ASSERT_TRUE(client.initialize("TestClient", "1.0.0"));
+        client.set_timeout(1);
+        client.set_max_in_flight(1);
+
+        auto start = std::chrono::steady_clock::now();
+        std::future<json> held = client.send_request_async("test/hold");
+        std::future<json> refused = client.send_request_async("test/hold");
+
+        ASSERT_EQ(refused.wait_for(std::chrono::milliseconds(0)), std::future_status::ready);
+        EXPECT_THROW(refused.get(), mcp_exception);
+
+        ASSERT_EQ(held.wait_for(std::chrono::seconds(3)), std::future_status::ready);
+        EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+        try {
+            held.get();
+            ADD_FAILURE() << "held request did not time out";
+        } catch (const mcp_exception& e) {
+            EXPECT_EQ(e.code(), error_code::request_timeout);
+        }
+
+        // The expired request gave its slot back
+        AdmissionEnvironment::open_gate();
+        EXPECT_NO_THROW(client.send_request_async("test/hold").get());
+    }
+    AdmissionEnvironment::open_gate();
+}
+
+// Batch test environment, test/echo returns its params after sleeping delay_ms
+class BatchEnvironment : public ::testing::Environment {
+public:
+    void SetUp() override {
+        server_ = std::make_unique<server>("localhost", 8086);
+        server_->set_server_info("TestServer", "1.0.0");
+        server_->set_streamable_http(true);
+        server_->register_method("test/echo", [](const json& params, const std::string& /* session_id */) -> json {
+            std::this_thread::sleep_for(std::chrono::milliseconds(params.value("delay_ms", 0)));
+            return params;
+        });
+        server_->start(false);
+    }
+
+    void TearDown() override {
+        server_->stop();
+        server_.reset();
+    }
+
+    static server& GetServer() {
+        return *server_;
+    }
+
+private:
+    static std::unique_ptr<server> server_;
+};
+
+std::unique_ptr<server> BatchEnvironment::server_;
+
+class BatchTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        session_ = std::make_unique<raw_session>(8086);
+        ASSERT_TRUE(session_->initialize());
+    }
+
+    static json echo(int value, int delay_ms) {
+        return request::create("test/echo", {{"value", value}, {"delay_ms", delay_ms}}).to_json();
+    }
+
+    // The earlier element is slower, so responses finish out of order
+    static void expect_mixed_responses(const json& batch, const json& answers) {
+        ASSERT_TRUE(answers.is_array());
+        ASSERT_EQ(answers.size(), 3u);
+        EXPECT_EQ(answers[0]["id"], batch[0]["id"]);
+        EXPECT_EQ(answers[0]["result"]["value"], 1);
+        EXPECT_EQ(answers[1]["id"], batch[2]["id"]);
+        EXPECT_EQ(answers[1]["result"]["value"], 2);
+        EXPECT_TRUE(answers[2]["id"].is_null());
+        EXPECT_EQ(answers[2]["error"]["code"], static_cast<int>(error_code::invalid_request));
+    }
+
+    static json mixed_batch() {
+        return json::array({echo(1, 100), request::create_notification("test").to_json(), echo(2, 0), 5});
+    }
+
+    const httplib::Headers inline_headers{{"Accept", "application/json, text/event-stream"}};
+    std::unique_ptr<raw_session> session_;
+};
+
+// Test a batch of requests, a notification and a malformed element answered over SSE
+TEST_F(BatchTest, MixedBatchOverSse) {
+    json batch = mixed_batch();
+    auto res = session_->post(batch.dump());
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 202);
+
+    json answers;
+    ASSERT_TRUE(session_->next_message(answers));
+    expect_mixed_responses(batch, answers);
+}
+
+// Test the same batch answered in the POST body
+TEST_F(BatchTest, MixedBatchInline) {
+    json batch = mixed_batch();
+    auto res = session_->post(batch.dump(), inline_headers);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    expect_mixed_responses(batch, json::parse(res->body));
+}
+
+// Test that an empty batch gets one invalid_request response object
+TEST_F(BatchTest, EmptyBatch) {
+    auto res = session_->post("[]");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 202);
+    json answer;
+    ASSERT_TRUE(session_->next_message(answer));
+    ASSERT_TRUE(answer.is_object());
+    EXPECT_TRUE(answer["id"].is_null());
+    EXPECT_EQ(answer["error"]["code"], static_cast<int>(error_code::invalid_request));
+
+    res = session_->post("[]", inline_headers);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    answer = json::parse(res->body);
+    ASSERT_TRUE(answer.is_object());
+    EXPECT_EQ(answer["error"]["code"], static_cast<int>(error_code::invalid_request));
+}
+
+// Test that a batch of notifications gets no response at all
+TEST_F(BatchTest, NotificationOnlyBatch) {
+    json batch = json::array({request::create_notification("test").to_json(), request::create_notification("test").to_json()});
+
+    auto res = session_->post(batch.dump());
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 202);
+    json answer;
+    EXPECT_FALSE(session_->next_message(answer, std::chrono::milliseconds(300)));
+
+    res = session_->post(batch.dump(), inline_headers);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 202);
+    EXPECT_TRUE(res->body.empty());
+}
+
+// Test that send_batch returns responses in request order whatever order they finish in,
+// over SSE and in the POST body
+TEST_F(BatchTest, ClientCorrelatesResponses) {
+    server& srv = BatchEnvironment::GetServer();
+    for (bool streamable : {false, true}) {
+        // The client always accepts an inline answer, the server decides how it responds
+        srv.set_streamable_http(streamable);
+        sse_client client("localhost", 8086);
+        ASSERT_TRUE(client.initialize("TestClient", "1.0.0"));
+
+        std::vector<request> requests = {
+            request::create("test/echo", {{"value", 1}, {"delay_ms", 150}}),
+            request::create_notification("test"),
+            request::create("test/unknown"),
+            request::create("test/echo", {{"value", 2}, {"delay_ms", 0}}),
+            request::create("test/echo", {{"value", 3}, {"delay_ms", 75}})
+        };
+        std::vector<response> responses = client.send_batch(requests);
+
+        ASSERT_EQ(responses.size(), 4u) << "streamable = " << streamable;
+        EXPECT_EQ(responses[0].id, requests[0].id);
+        EXPECT_EQ(responses[0].result["value"], 1);
+        EXPECT_EQ(responses[1].id, requests[2].id);
+        EXPECT_TRUE(responses[1].is_error());
+        EXPECT_EQ(responses[2].id, requests[3].id);
+        EXPECT_EQ(responses[2].result["value"], 2);
+        EXPECT_EQ(responses[3].id, requests[4].id);
+        EXPECT_EQ(responses[3].result["value"], 3);
+    }
+    srv.set_streamable_http(true);
+}
+
+// Test that a streamable request not done by the deadline is answered with a timeout error
+TEST_F(BatchTest, InlineResponseTimeout) {
+    server& srv = BatchEnvironment::GetServer();
+    srv.set_inline_response_timeout(std::chrono::milliseconds(100));
+
+    json slow = echo(1, 500);
+    auto res = session_->post(slow.dump(), inline_headers);
+    srv.set_inline_response_timeout(std::chrono::seconds(60));
+
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    json answer = json::parse(res->body);
+    EXPECT_EQ(answer["id"], slow["id"]);
+    EXPECT_EQ(answer["error"]["code"], static_cast<int>(error_code::internal_error));
+}
+
+// Test that sse_client keeps concurrent requests in flight against a streamable server that holds
+// each POST open until its result is ready. The fake server only answers once two requests are open.
+TEST(StreamableClientTest, ConcurrentPostsDoNotSerialize) {
+    httplib::Server fake;
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::condition_variable cv;
+    int open_requests = 0;
+
+    fake.Get("/sse", [&](const httplib::Request&, httplib::Response& res) {
+        auto sent = std::make_shared<bool>(false);
+        res.set_chunked_content_provider("text/event-stream", [&, sent](size_t, httplib::DataSink& sink) {
+            if (!*sent) {
+                *sent = true;
+                std::string event = "event: endpoint\r\ndata: /message\r\n\r\n";
+                return sink.write(event.data(), event.size());
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            return !stopping.load();
+        });
+    });
+    fake.Post("/message", [&](const httplib::Request& req, httplib::Response& res) {
+        json message = json::parse(req.body);
+        if (!message.contains("id")) {
+            res.status = 202;
+            return ;
+        }
+
+        json result = json::object();
+        if (message["method"] == "initialize") {
+            result = {{"protocolVersion", MCP_VERSION}, {"capabilities", json::object()}, {"serverInfo", {{"name", "Fake"}, {"version", "1.0.0"}}}};
+        } else {
+            std::unique_lock<std::mutex> lock(mutex);
+            ++open_requests;
+            cv.notify_all();
+            result["concurrent"] = cv.wait_for(lock, std::chrono::seconds(5), [&]() { return open_requests >= 2; });
+        }
+        res.set_content(response::create_success(message["id"], result).to_json().dump(), "application/json");
+    });
+
+    int port = fake.bind_to_any_port("localhost");
+    std::thread listener([&]() { fake.listen_after_bind(); });
+    fake.wait_until_ready();
+
+    {
+        sse_client client("localhost", port);
+        ASSERT_TRUE(client.initialize("TestClient", "1.0.0"));
+
+        std::vector<json> results(2);
+        std::vector<std::thread> callers;
+        for (size_t i = 0; i < results.size(); ++i) {
+            callers.emplace_back([&client, &results, i]() {
+                results[i] = client.send_request("test/wait").result;
+            });
+        }
+        for (auto& caller : callers) {
+            caller.join();
+        }
+
+        for (const auto& result : results) {
+            EXPECT_EQ(result["concurrent"], true);
+        }
+    }
+
+    stopping.store(true);
+    fake.stop();
+    listener.join();
+}
+
+// Async tool test environment, wait_for_cancel runs until its token is cancelled
+class AsyncToolEnvironment : public ::testing::Environment {
+public:
+    void SetUp() override {
+        server_ = std::make_unique<server>("localhost", 8087);
+        server_->set_server_info("TestServer", "1.0.0");
+
+        auto wait_for_cancel = [](const json& /* params */, const std::string& /* session_id */, const cancellation_token& token) -> json {
+            auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (!token.is_cancelled() && std::chrono::steady_clock::now() < give_up) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            handler_saw_cancel_ = token.is_cancelled();
+            return json::array();
+        };
+        server_->register_async_tool(tool{"wait_for_cancel", "Runs until cancelled", {{"type", "object"}}}, wait_for_cancel);
+        server_->register_async_tool(tool{"short_deadline", "Runs past its deadline", {{"type", "object"}}}, wait_for_cancel, std::chrono::milliseconds(200));
+        server_->register_async_tool(tool{"echo", "Returns its arguments", {{"type", "object"}}},
+            [](const json& params, const std::string& /* session_id */, const cancellation_token& /* token */) -> json {
+                return json::array({{{"type", "text"}, {"text", params.value("text", "")}}});
+            });
+
+        server_->start(false);
+    }
+
+    void TearDown() override {
+        server_->stop();
+        server_.reset();
+    }
+
+    static std::atomic<bool> handler_saw_cancel_;
+
+private:
+    static std::unique_ptr<server> server_;
+};
+
+std::unique_ptr<server> AsyncToolEnvironment::server_;
+std::atomic<bool> AsyncToolEnvironment::handler_saw_cancel_{false};
+
+class AsyncToolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        AsyncToolEnvironment::handler_saw_cancel_ = false;
+        session_ = std::make_unique<raw_session>(8087);
+        ASSERT_TRUE(session_->initialize());
+    }
+
+    static json call(const std::string& name, const json& arguments = json::object()) {
+        return request::create("tools/call", {{"name", name}, {"arguments", arguments}}).to_json();
+    }
+
+    std::unique_ptr<raw_session> session_;
+};
+
+// Test that an async tool is answered with its result
+TEST_F(AsyncToolTest, CompletesWithResult) {
+    json echo = call("echo", {{"text", "hello"}});
+    auto res = session_->post(echo.dump());
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 202);
+
+    json answer;
+    ASSERT_TRUE(session_->next_message(answer));
+    EXPECT_EQ(answer["id"], echo["id"]);
+    EXPECT_FALSE(answer["result"]["isError"]);
+    EXPECT_EQ(answer["result"]["content"][0]["text"], "hello");
+}
+
+// Test that notifications/cancelled answers the call right away and cancels the handler's token
+TEST_F(AsyncToolTest, CancelRequest) {
+    json running = call("wait_for_cancel");
+    ASSERT_TRUE(session_->post(running.dump()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto start = std::chrono::steady_clock::now();
+    json cancel = request::create_notification("cancelled", {{"requestId", running["id"]}, {"reason", "test"}}).to_json();
+    auto res = session_->post(cancel.dump());
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 202);
+
+    json answer;
+    ASSERT_TRUE(session_->next_message(answer, std::chrono::seconds(2)));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+    EXPECT_EQ(answer["id"], running["id"]);
+    EXPECT_EQ(answer["error"]["code"], static_cast<int>(error_code::request_cancelled));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!AsyncToolEnvironment::handler_saw_cancel_ && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(AsyncToolEnvironment::handler_saw_cancel_);
+
+    // The handler returning later does not answer a second time
+    EXPECT_FALSE(session_->next_message(answer, std::chrono::milliseconds(200)));
+}
+
+// Test that a call still running at its deadline is answered with request_timeout
+TEST_F(AsyncToolTest, DeadlineExpiry) {
+    json running = call("short_deadline");
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(session_->post(running.dump()));
+
+    json answer;
+    ASSERT_TRUE(session_->next_message(answer, std::chrono::seconds(2)));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(200));
+    EXPECT_LT(elapsed, std::chrono::seconds(1));
+    EXPECT_EQ(answer["id"], running["id"]);
+    EXPECT_EQ(answer["error"]["code"], static_cast<int>(error_code::request_timeout));
+}
+
+// Test that a call still running when its session closes is cancelled
+TEST_F(AsyncToolTest, SessionCloseCancelsCall) {
+    ASSERT_TRUE(session_->post(call("wait_for_cancel").dump()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    session_.reset();
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!AsyncToolEnvironment::handler_saw_cancel_ && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(AsyncToolEnvironment::handler_saw_cancel_);
+}
+
+// Test session event queue
+class EventDispatcherTest : public ::testing::Test {
+protected:
+    // Collect everything written to the sink
+    void attach_sink(httplib::DataSink& sink, std::string& out) {
+        sink.write = [&out](const char* data, size_t length) {
+            out.append(data, length);
+            return true;
+        };
+    }
+};
+
+// Test that queued events are not overwritten before they are delivered
+TEST_F(EventDispatcherTest, QueuedEventsAreDelivered) {
+    event_dispatcher dispatcher(4);
+    EXPECT_TRUE(dispatcher.send_event("event: message\r\ndata: 1\r\n\r\n"));
+    EXPECT_TRUE(dispatcher.send_event("event: message\r\ndata: 2\r\n\r\n"));
+    EXPECT_EQ(dispatcher.queue_size(), 2);
+
+    std::string out;
+    httplib::DataSink sink;
+    attach_sink(sink, out);
+    EXPECT_TRUE(dispatcher.wait_event(&sink, std::chrono::milliseconds(100)));
+    EXPECT_EQ(out, "event: message\r\ndata: 1\r\n\r\nevent: message\r\ndata: 2\r\n\r\n");
+    EXPECT_EQ(dispatcher.queue_size(), 0);
+}
+
+// Test that a burst of queued events reaches the sink in a single write
+TEST_F(EventDispatcherTest, CoalescesQueuedEventsIntoOneWrite) {
+    event_dispatcher dispatcher(64);
+    for (int i = 0; i < 32; ++i) {
+        EXPECT_TRUE(dispatcher.send_event("data: " + std::to_string(i) + "\r\n\r\n"));
+    }
+
+    std::string out;
+    int writes = 0;
+    httplib::DataSink sink;
+    sink.write = [&out, &writes](const char* data, size_t length) {
+        writes++;
+        out.append(data, length);
+        return true;
+    };
+
+    EXPECT_TRUE(dispatcher.wait_event(&sink, std::chrono::milliseconds(100)));
+    EXPECT_EQ(writes, 1);
+    EXPECT_EQ(out.find("data: 0\r\n\r\n"), 0u);
+    EXPECT_NE(out.find("data: 31\r\n\r\n"), std::string::npos);
+    EXPECT_EQ(dispatcher.queue_size(), 0u);
+}
+
+// Test overflow policies of a full queue
+TEST_F(EventDispatcherTest, OverflowPolicy) {
+    event_dispatcher dropping(2, queue_overflow_policy::drop_oldest_heartbeat);
+    EXPECT_TRUE(dropping.send_event("heartbeat", true));
+    EXPECT_TRUE(dropping.send_event("first"));
+    EXPECT_TRUE(dropping.send_event("second"));
+    EXPECT_TRUE(dropping.send_event("heartbeat", true));
+
+    std::string out;
+    httplib::DataSink sink;
+    attach_sink(sink, out);
+    EXPECT_TRUE(dropping.wait_event(&sink, std::chrono::milliseconds(100)));
+    EXPECT_EQ(out, "firstsecond");
+
+    event_dispatcher failing(1, queue_overflow_policy::fail);
+    EXPECT_TRUE(failing.send_event("first"));
+    EXPECT_FALSE(failing.send_event("second"));
+
+    // Nothing drains the queue, a blocked send gives up after the send timeout
+    event_dispatcher blocking(1, queue_overflow_policy::block, std::chrono::milliseconds(50));
+    EXPECT_TRUE(blocking.send_event("first"));
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(blocking.send_event("second"));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+}
+
+// Test that closing a dispatcher still flushes what was queued before the close
+TEST_F(EventDispatcherTest, CloseFlushesQueuedEvents) {
+    event_dispatcher dispatcher(4);
+    EXPECT_TRUE(dispatcher.send_event("first"));
+    EXPECT_TRUE(dispatcher.send_event("second"));
+    dispatcher.close();
+    EXPECT_FALSE(dispatcher.send_event("third"));
+
+    std::string out;
+    httplib::DataSink sink;
+    attach_sink(sink, out);
+    EXPECT_FALSE(dispatcher.wait_event(&sink, std::chrono::milliseconds(100)));
+    EXPECT_EQ(out, "firstsecond");
+    EXPECT_FALSE(dispatcher.wait_event(&sink, std::chrono::milliseconds(100)));
+}
+
+// Test that activity timestamps are updated and read concurrently without a lock
+TEST_F(EventDispatcherTest, ActivityTimestamp) {
+    event_dispatcher dispatcher(4);
+    auto before = std::chrono::steady_clock::now();
+    dispatcher.update_activity();
+    EXPECT_GE(dispatcher.last_activity(), before);
+
+    // Every value a reader sees is a whole timestamp written by some update
+    std::atomic<bool> done{false};
+    std::atomic<int> out_of_range{0};
+    std::thread reader([&dispatcher, &done, &out_of_range, before]() {
+        while (!done) {
+            auto seen = dispatcher.last_activity();
+            if (seen < before || seen > std::chrono::steady_clock::now()) {
+                out_of_range++;
+            }
+        }
+    });
+
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 4; ++i) {
+        writers.emplace_back([&dispatcher]() {
+            for (int j = 0; j < 10000; ++j) {
+                dispatcher.update_activity();
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    auto after = std::chrono::steady_clock::now();
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(out_of_range.load(), 0);
+    EXPECT_GE(dispatcher.last_activity(), before);
+    EXPECT_LE(dispatcher.last_activity(), after);
+}
+
+// Test work-stealing thread pool
+TEST(ThreadPoolTest, EnqueueFromWorkersAndExternalThreads) {
+    thread_pool pool(4);
+    std::atomic<int> counter{0};
+
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 1000; ++i) {
+        futures.push_back(pool.enqueue([&counter](int value) {
+            counter += value;
+            return value;
+        }, 1));
+    }
+
+    // Tasks submitted from a worker land on its own deque and can be stolen by the others
+    auto nested = pool.enqueue([&pool, &counter]() {
+        std::vector<std::future<void>> inner;
+        for (int i = 0; i < 100; ++i) {
+            inner.push_back(pool.enqueue([&counter]() { counter++; }));
+        }
+        return inner.size();
+    });
+
+    for (auto& future : futures) {
+        EXPECT_EQ(future.get(), 1);
+    }
+    EXPECT_EQ(nested.get(), 100);
+
+    // The nested tasks were queued before their parent finished, so an idle pool has run them all
+    ASSERT_TRUE(pool.wait_idle(std::chrono::seconds(5)));
+    EXPECT_EQ(counter.load(), 1100);
+}
+
+// Test draining the thread pool with a deadline
+TEST(ThreadPoolTest, WaitIdle) {
+    thread_pool pool(4);
+    std::atomic<int> counter{0};
+    for (int i = 0; i < 100; ++i) {
+        pool.enqueue([&counter]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            counter++;
+        });
+    }
+    EXPECT_TRUE(pool.wait_idle(std::chrono::seconds(5)));
+    EXPECT_EQ(counter.load(), 100);
+
+    // A task that outlives the deadline
+    pool.enqueue([]() { std::this_thread::sleep_for(std::chrono::milliseconds(200)); });
+    EXPECT_FALSE(pool.wait_idle(std::chrono::milliseconds(20)));
+    EXPECT_TRUE(pool.wait_idle(std::chrono::seconds(5)));
+}
+
+// Test that high priority tasks overtake queued normal work
+TEST(ThreadPoolTest, HighPriorityRunsFirst) {
+    thread_pool pool(1);
+    std::atomic<bool> release{false};
+    pool.post([&release]() {
+        while (!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::mutex order_mutex;
+    std::vector<int> order;
+    for (int i = 0; i < 10; ++i) {
+        pool.post([&order_mutex, &order, i]() {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(i);
+        });
+    }
+    pool.post([&order_mutex, &order]() {
+        std::lock_guard<std::mutex> lock(order_mutex);
+        order.push_back(-1);
+    }, task_priority::high);
+
+    release = true;
+    ASSERT_TRUE(pool.wait_idle(std::chrono::seconds(5)));
+    ASSERT_EQ(order.size(), 11u);
+    EXPECT_EQ(order.front(), -1);
+}
+
+// Test per-session lanes on a shared thread pool
+TEST(ThreadPoolTest, TaskLaneOrderingAndConcurrency) {
+    thread_pool pool(4);
+
+    // A serial lane runs its tasks one at a time in posting order
+    auto serial = std::make_shared<task_lane>(pool, 1);
+    std::vector<int> order;
+    for (int i = 0; i < 200; ++i) {
+        serial->post([&order, i]() { order.push_back(i); });
+    }
+
+    // A lane limited to two concurrent tasks never holds more pool slots
+    auto limited = std::make_shared<task_lane>(pool, 2);
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    for (int i = 0; i < 50; ++i) {
+        limited->post([&running, &max_running]() {
+            int now = ++running;
+            int seen = max_running.load();
+            while (now > seen && !max_running.compare_exchange_weak(seen, now)) {}
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            running--;
+        });
+    }
+
+    ASSERT_TRUE(pool.wait_idle(std::chrono::seconds(10)));
+    ASSERT_EQ(order.size(), 200u);
+    for (int i = 0; i < 200; ++i) {
+        EXPECT_EQ(order[i], i);
+    }
+    EXPECT_LE(max_running.load(), 2);
+    EXPECT_EQ(limited->queued(), 0u);
+}
+
+// Test that a flooding session does not delay the request of another session
+TEST(ThreadPoolTest, FloodingLaneDoesNotDelayAnotherLane) {
+    thread_pool pool(2);
+
+    // Default lanes, no per-session cap
+    auto flooding = std::make_shared<task_lane>(pool, 0);
+    auto quiet = std::make_shared<task_lane>(pool, 0);
+
+    std::atomic<int> flood_done{0};
+    for (int i = 0; i < 500; ++i) {
+        flooding->post([&flood_done]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            flood_done++;
+        });
+    }
+
+    std::promise<int> quiet_ran;
+    quiet->post([&quiet_ran, &flood_done]() { quiet_ran.set_value(flood_done.load()); });
+
+    auto future = quiet_ran.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    // The quiet lane waits for about one round of the flooding lane's slots, not for its whole backlog
+    EXPECT_LE(future.get(), static_cast<int>(4 * pool.size()));
+
+    ASSERT_TRUE(pool.wait_idle(std::chrono::seconds(10)));
+    EXPECT_EQ(flood_done.load(), 500);
+}
+
+// Test that a cancelled timer never fires, whether it is waiting or periodic
+TEST(TimerWheelTest, CancelledTimerNeverFires) {
+    timer_wheel wheel(std::chrono::milliseconds(10));
+    std::atomic<int> cancelled_fired{0};
+    std::atomic<int> control_fired{0};
+    std::atomic<int> periodic_fired{0};
+
+    auto waiting = wheel.schedule(std::chrono::milliseconds(50), [&cancelled_fired]() { cancelled_fired++; });
+    wheel.schedule(std::chrono::milliseconds(100), [&control_fired]() { control_fired++; });
+    auto periodic = wheel.schedule_every(std::chrono::milliseconds(10), std::chrono::milliseconds(10), [&periodic_fired]() {
+        periodic_fired++;
+        return true;
+    });
+    EXPECT_TRUE(wheel.cancel(waiting));
+    EXPECT_FALSE(wheel.cancel(waiting));
+
+    for (int i = 0; i < 200 && periodic_fired < 3; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_TRUE(wheel.cancel(periodic));
+    int fired_at_cancel = periodic_fired.load();
+
+    for (int i = 0; i < 200 && control_fired == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(control_fired.load(), 1);
+    EXPECT_EQ(cancelled_fired.load(), 0);
+    // A callback already running when cancel was called may still complete
+    EXPECT_LE(periodic_fired.load(), fired_at_cancel + 1);
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+// Test that timers expire no earlier than their delay and at most one tick after it
+TEST(TimerWheelTest, ExpiryWithinOneTick) {
+    const auto tick = std::chrono::milliseconds(50);
+    // Allowance for the wheel thread being scheduled late on a loaded machine
+    const auto scheduling_slack = std::chrono::milliseconds(50);
+    timer_wheel wheel(tick);
+
+    std::vector<std::chrono::milliseconds> delays = {
+        std::chrono::milliseconds(30), std::chrono::milliseconds(120), std::chrono::milliseconds(275)
+    };
+    std::vector<std::promise<std::chrono::steady_clock::duration>> fired(delays.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < delays.size(); ++i) {
+        wheel.schedule(delays[i], [&fired, i, start]() {
+            fired[i].set_value(std::chrono::steady_clock::now() - start);
+        });
+    }
+
+    for (size_t i = 0; i < delays.size(); ++i) {
+        auto future = fired[i].get_future();
+        ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        auto elapsed = future.get();
+        EXPECT_GE(elapsed, delays[i]);
+        EXPECT_LE(elapsed, delays[i] + tick + scheduling_slack);
+    }
+}
+
+// Test concurrent insert, erase and for_each on the sharded map
+TEST(ShardedMapTest, ConcurrentInsertEraseAndForEach) {
+    sharded_map<int, int> map;
+    const int per_thread = 2000;
+    std::atomic<bool> writers_done{false};
+    std::atomic<int> bad_entries{0};
+
+    // Writers own disjoint key ranges and erase every odd key again
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&map, t, per_thread]() {
+            for (int i = 0; i < per_thread; ++i) {
+                int key = t * per_thread + i;
+                map.insert(key, std::make_shared<int>(key));
+                if (key % 2 == 1) {
+                    EXPECT_NE(map.erase(key), nullptr);
+                }
+            }
+        });
+    }
+
+    // A reader iterates while the writers run, every value it sees belongs to its key
+    std::thread reader([&map, &writers_done, &bad_entries]() {
+        while (!writers_done) {
+            map.for_each([&bad_entries](const int& key, const std::shared_ptr<int>& value) {
+                if (!value || *value != key) {
+                    bad_entries++;
+                }
+            });
+        }
+    });
+
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    writers_done = true;
+    reader.join();
+
+    EXPECT_EQ(bad_entries.load(), 0);
+    EXPECT_EQ(map.size(), static_cast<size_t>(4 * per_thread / 2));
+    size_t visited = 0;
+    map.for_each([&visited](const int& key, const std::shared_ptr<int>& /* value */) {
+        EXPECT_EQ(key % 2, 0);
+        visited++;
+    });
+    EXPECT_EQ(visited, map.size());
+    EXPECT_EQ(map.find(1), nullptr);
+    ASSERT_NE(map.find(2), nullptr);
+    EXPECT_EQ(*map.find(2), 2);
+}
+
+// Test that a reader keeps its snapshot while a writer publishes a new version
+TEST(CopyOnWriteTest, ReaderKeepsSnapshotAcrossUpdate) {
+    copy_on_write<std::map<std::string, int>> cell;
+    cell.update([](std::map<std::string, int>& value) { value["a"] = 1; });
+
+    auto snapshot = cell.load();
+    cell.update([](std::map<std::string, int>& value) {
+        value["a"] = 2;
+        value["b"] = 3;
+    });
+
+    EXPECT_EQ(snapshot->size(), 1u);
+    EXPECT_EQ(snapshot->at("a"), 1);
+    auto latest = cell.load();
+    EXPECT_EQ(latest->size(), 2u);
+    EXPECT_EQ(latest->at("a"), 2);
+
+    // Concurrent readers only ever see complete versions
+    copy_on_write<std::vector<int>> versions;
+    std::atomic<bool> done{false};
+    std::atomic<int> torn{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&versions, &done, &torn]() {
+            while (!done) {
+                auto current = versions.load();
+                for (size_t j = 0; j < current->size(); ++j) {
+                    if ((*current)[j] != static_cast<int>(current->size())) {
+                        torn++;
+                    }
+                }
+            }
+        });
+    }
+    for (int n = 1; n <= 200; ++n) {
+        versions.update([n](std::vector<int>& value) { value.assign(n, n); });
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(torn.load(), 0);
+    EXPECT_EQ(versions.load()->size(), 200u);
+}
+
+#if defined(__linux__)
+// Test that the event loop frames queued events as chunks and ends the stream once the dispatcher closes
+TEST(SseReactorTest, WritesChunksAndEndsStream) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    timeval timeout{5, 0};
+    setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Read until expected has arrived, or until the end of the stream if expected is empty
+    auto read_stream = [&fds](size_t expected) {
+        std::string out;
+        char buffer[256];
+        while (expected == 0 || out.size() < expected) {
+            ssize_t n = recv(fds[1], buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                break;
+            }
+            out.append(buffer, n);
+        }
+        return out;
+    };
+
+    sse_reactor<event_dispatcher> reactor(1);
+    auto dispatcher = std::make_shared<event_dispatcher>();
+    std::atomic<bool> closed{false};
+
+    // Queued before the hand-off, picked up by the first flush
+    ASSERT_TRUE(dispatcher->send_event("data: 1\r\n\r\n"));
+    ASSERT_TRUE(reactor.add(fds[0], dispatcher, [&closed]() { closed = true; }));
+    EXPECT_EQ(read_stream(16), "b\r\ndata: 1\r\n\r\n\r\n");
+
+    ASSERT_TRUE(dispatcher->send_event("data: 22\r\n\r\n"));
+    EXPECT_EQ(read_stream(17), "c\r\ndata: 22\r\n\r\n\r\n");
+    EXPECT_EQ(reactor.stream_count(), 1u);
+
+    // Queued before the close, still delivered, then the terminating chunk
+    ASSERT_TRUE(dispatcher->send_event("data: 3\r\n\r\n"));
+    dispatcher->close();
+    EXPECT_EQ(read_stream(0), "b\r\ndata: 3\r\n\r\n\r\n0\r\n\r\n");
+
+    for (int i = 0; i < 500 && !closed; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_TRUE(closed);
+    EXPECT_EQ(reactor.stream_count(), 0u);
+    close(fds[1]);
+}
+
+// Test that open SSE streams do not use up httplib's connection threads
+TEST(SseReactorTest, StreamsDoNotHoldConnectionThreads) {
+    server srv("localhost", 8088);
+    srv.set_server_info("TestServer", "1.0.0");
+    srv.start(false);
+
+    {
+        // Three times as many streams as connection threads, every one still gets its requests answered
+        std::vector<std::unique_ptr<raw_session>> sessions;
+        for (size_t i = 0; i < 3 * CPPHTTPLIB_THREAD_POOL_COUNT; ++i) {
+            sessions.push_back(std::make_unique<raw_session>(8088));
+        }
+        for (auto& session : sessions) {
+            ASSERT_TRUE(session->initialize());
+        }
+        EXPECT_EQ(srv.get_queue_stats().sessions, sessions.size());
+
+        auto res = sessions.front()->post(request::create("ping").to_json().dump());
+        ASSERT_TRUE(res);
+        EXPECT_EQ(res->status, 202);
+        json message;
+        ASSERT_TRUE(sessions.front()->next_message(message));
+        EXPECT_TRUE(message.contains("result"));
+    }
+
+    // Disconnected clients close their sessions
+    size_t open_sessions = srv.get_queue_stats().sessions;
+    for (int i = 0; i < 500 && open_sessions > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        open_sessions = srv.get_queue_stats().sessions;
+    }
+    EXPECT_EQ(open_sessions, 0u);
+    srv.stop();
+}
+#endif
+
+// Test the incremental SSE parser
+TEST(SseParserTest, ChunkedStreamWithMixedLineEndings) {
+    std::vector<std::pair<std::string, std::string>> events;
+    sse_parser parser([&events](std::string_view event_type, std::string_view data) {
+        events.emplace_back(std::string(event_type), std::string(data));
+    });
+
+    const std::string stream =
+        "event: endpoint\r\ndata: /message?session_id=1\r\n\r\n"
+        ": comment\nevent: heartbeat\ndata: 0\n\n"
+        "data: line1\r\ndata: line2\r\n\r\n"
+        "event: message\rdata: {\"id\":1}\r\r\n";
+
+    // One byte at a time splits every CRLF and field
+    for (char c : stream) {
+        parser.feed(&c, 1);
+    }
+
+    ASSERT_EQ(events.size(), 4u);
+    EXPECT_EQ(events[0], std::make_pair(std::string("endpoint"), std::string("/message?session_id=1")));
+    EXPECT_EQ(events[1], std::make_pair(std::string("heartbeat"), std::string("0")));
+    EXPECT_EQ(events[2], std::make_pair(std::string("message"), std::string("line1\nline2")));
+    EXPECT_EQ(events[3], std::make_pair(std::string("message"), std::string("{\"id\":1}")));
+}
+
+// Test session ID generation
+TEST(SessionIdTest, FormatAndUniqueness) {
+    std::set<std::string> ids;
+    for (int i = 0; i < 10000; ++i) {
+        std::string id = generate_uuid();
+        ASSERT_EQ(id.size(), uuid_length);
+        EXPECT_EQ(id[8], '-');
+        EXPECT_EQ(id[13], '-');
+        EXPECT_EQ(id[18], '-');
+        EXPECT_EQ(id[23], '-');
+        // Version 4, RFC 4122 variant
+        EXPECT_EQ(id[14], '4');
+        EXPECT_NE(std::string("89ab").find(id[19]), std::string::npos);
+        ids.insert(id);
+    }
+    EXPECT_EQ(ids.size(), 10000u);
+
+    // Different threads use independent keys and must not collide either
+    std::string other;
+    std::thread([&other]() { other = generate_uuid(); }).join();
+    EXPECT_EQ(ids.count(other), 0u);
+}
+
+// Micro benchmark of the connect path cost of generating a session ID.
+// Disabled by default, run with --gtest_also_run_disabled_tests --gtest_filter=SessionIdTest.*
+TEST(SessionIdTest, DISABLED_GenerationCost) {
+    const int iterations = 1000000;
+    char buffer[uuid_length];
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        generate_uuid(buffer);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double ns_per_id = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+    std::cout << "generate_uuid: " << ns_per_id << " ns per session ID" << std::endl;
+}
+
+// Test request IDs are unique when requests are created on several threads
+TEST(RequestIdTest, UniqueAcrossThreads) {
+    const int per_thread = 10000;
+    std::vector<std::vector<uint64_t>> ids(4);
+    std::vector<std::thread> threads;
+    for (auto& out : ids) {
+        threads.emplace_back([&out, per_thread]() {
+            for (int i = 0; i < per_thread; ++i) {
+                out.push_back(request::create("ping").id.get<uint64_t>());
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::set<uint64_t> unique;
+    for (const auto& out : ids) {
+        unique.insert(out.begin(), out.end());
+    }
+    EXPECT_EQ(unique.size(), ids.size() * per_thread);
+}
+
+// Test the pending request table with integer and foreign IDs
+TEST(PendingTableTest, IntegerAndForeignIds) {
+    pending_table<int> table(16);
+
+    // Enough entries to grow the table several times
+    for (int i = 1; i <= 1000; ++i) {
+        table.insert(json(i), i);
+    }
+    table.insert(json("abc"), -1);
+    table.insert(json(-5), -5);
+    EXPECT_EQ(table.size(), 1002u);
+
+    // A parsed response ID matches the ID the request was sent with
+    int value = 0;
+    EXPECT_TRUE(table.take(json::parse("500"), value));
+    EXPECT_EQ(value, 500);
+    EXPECT_FALSE(table.take(json(500), value));
+
+    // Removing from the middle of probe runs keeps the rest reachable
+    for (int i = 1; i <= 1000; i += 2) {
+        EXPECT_TRUE(table.erase(json(i)));
+    }
+    for (int i = 2; i <= 1000; i += 2) {
+        if (i == 500) {
+            continue;
+        }
+        ASSERT_TRUE(table.take(json(i), value));
+        EXPECT_EQ(value, i);
+    }
+
+    EXPECT_TRUE(table.take(json("abc"), value));
+    EXPECT_EQ(value, -1);
+    EXPECT_EQ(table.take_all(), std::vector<int>{-5});
+    EXPECT_TRUE(table.empty());
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     
@@ -666,6 +2080,10 @@ int main(int argc, char **argv) {
     ::testing::AddGlobalTestEnvironment(new VersioningEnvironment());
     ::testing::AddGlobalTestEnvironment(new PingEnvironment());
     ::testing::AddGlobalTestEnvironment(new ToolsEnvironment());
+    ::testing::AddGlobalTestEnvironment(new PaginationEnvironment());
+    ::testing::AddGlobalTestEnvironment(new AdmissionEnvironment());
+    ::testing::AddGlobalTestEnvironment(new BatchEnvironment());
+    ::testing::AddGlobalTestEnvironment(new AsyncToolEnvironment());
     
     return RUN_ALL_TESTS();
 } 
\ No newline at end of file